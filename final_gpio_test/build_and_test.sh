@@ -7,7 +7,7 @@ set -e
 
 DRIVER_NAME="gpio_driver"
 TEST_APP="gpio_test"
-DEVICE="/dev/simple_gpio"
+DEVICE="/dev/simple_gpio0"
 
 # Colors for output
 RED='\033[0;31m'
@@ -72,7 +72,10 @@ load_driver() {
     fi
     
     # Check if IRQ parameter was provided
-    if [ ! -z "$IRQ_NUM" ]; then
+    if [ "$SIM" = "1" ]; then
+        print_status "Loading with simulated registers"
+        insmod ${DRIVER_NAME}.ko sim=1
+    elif [ ! -z "$IRQ_NUM" ]; then
         print_status "Loading with IRQ number: $IRQ_NUM"
         insmod ${DRIVER_NAME}.ko gpio_irq=$IRQ_NUM
     else
@@ -156,6 +159,7 @@ show_help() {
     echo ""
     echo "Usage: $0 [command]"
     echo "       IRQ_NUM=<num> $0 [command]  # To specify IRQ number"
+    echo "       SIM=1 $0 [command]          # Use the simulated register bank"
     echo ""
     echo "Commands:"
     echo "  build       - Build both driver and test application"
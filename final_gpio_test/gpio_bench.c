@@ -0,0 +1,463 @@
+/*
+ * GPIO Driver Benchmark Suite
+ * Measures per-ioctl latency, op throughput and edge-to-wakeup latency,
+ * writes the results as flat JSON and compares them against a baseline
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <string.h>
+#include <errno.h>
+#include "gpio_contention.h"
+
+#define DEVICE_PATH "/dev/simple_gpio0"
+#define SIM_INPUTS_PATH "/sys/kernel/debug/simple_gpio/bank0/sim_inputs"
+#define NUM_PINS 8
+#define BENCH_PIN 0         /* output pin used by the latency/throughput runs */
+#define EDGE_PIN 7          /* input pin toggled for edge-to-wakeup */
+#define MAX_RESULTS 128
+#define MAX_KEY 64
+
+struct result {
+    char key[MAX_KEY];
+    double value;
+};
+
+static struct result results[MAX_RESULTS];
+static int num_results;
+
+static void add_result(const char *key, double value)
+{
+    if (num_results < MAX_RESULTS) {
+        snprintf(results[num_results].key, MAX_KEY, "%s", key);
+        results[num_results].value = value;
+        num_results++;
+    }
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Sorts samples in place and records p50/p99/p999 under prefix */
+static void add_percentiles(const char *prefix, unsigned long long *samples, int n)
+{
+    char key[MAX_KEY];
+
+    qsort(samples, n, sizeof(*samples), cmp_u64);
+
+    snprintf(key, sizeof(key), "%s.p50_ns", prefix);
+    add_result(key, samples[n / 2]);
+    snprintf(key, sizeof(key), "%s.p99_ns", prefix);
+    add_result(key, samples[(int)(n * 0.99)]);
+    snprintf(key, sizeof(key), "%s.p999_ns", prefix);
+    add_result(key, samples[(int)(n * 0.999)]);
+
+    printf("%-28s p50 %8llu  p99 %8llu  p999 %8llu ns\n", prefix,
+           samples[n / 2], samples[(int)(n * 0.99)], samples[(int)(n * 0.999)]);
+}
+
+/*
+ * Latency
+ */
+
+struct ioctl_case {
+    const char *name;
+    unsigned long request;
+};
+
+static struct gpio_batch_op batch_ops[8];
+static struct gpio_batch batch_arg;
+static struct gpio_bank_state bank_arg;
+static struct gpio_mask mask_arg;
+static struct gpio_event_stats event_stats_arg;
+static struct gpio_irq_stats irq_stats_arg;
+
+/* Argument for each request, set up so every call succeeds */
+static void *ioctl_arg(unsigned long request, struct gpio_config *config, int i)
+{
+    config->gpio_num = BENCH_PIN;
+
+    switch (request) {
+    case GPIO_SET_DIRECTION:
+        config->value = GPIO_DIR_OUTPUT;
+        return config;
+    case GPIO_WRITE_PIN:
+        config->value = i & 1;
+        return config;
+    case GPIO_SET_INTERRUPT:
+    case GPIO_READ_PIN:
+    case GPIO_READ_INT_STATUS:
+    case GPIO_CLEAR_INT_STATUS:
+        config->value = GPIO_INT_DISABLE;
+        return config;
+    case GPIO_SET_EDGE:
+        config->value = GPIO_EDGE_BOTH;
+        return config;
+    case GPIO_SET_DEBOUNCE:
+        config->value = 0;
+        return config;
+    case GPIO_BATCH:
+        batch_arg.ops = (unsigned long)batch_ops;
+        batch_arg.count = 8;
+        batch_arg.flags = 0;
+        return &batch_arg;
+    case GPIO_READ_ALL:
+        return &bank_arg;
+    case GPIO_WRITE_MASK:
+        mask_arg.mask = 1 << BENCH_PIN;
+        mask_arg.value = (i & 1) << BENCH_PIN;
+        return &mask_arg;
+    case GPIO_GET_EVENT_STATS:
+        return &event_stats_arg;
+    case GPIO_GET_IRQ_STATS:
+        return &irq_stats_arg;
+    }
+    return NULL;
+}
+
+static void bench_latency(int fd, int iterations)
+{
+    static const struct ioctl_case cases[] = {
+        { "set_direction", GPIO_SET_DIRECTION },
+        { "read_pin", GPIO_READ_PIN },
+        { "write_pin", GPIO_WRITE_PIN },
+        { "set_interrupt", GPIO_SET_INTERRUPT },
+        { "read_int_status", GPIO_READ_INT_STATUS },
+        { "clear_int_status", GPIO_CLEAR_INT_STATUS },
+        { "batch8", GPIO_BATCH },
+        { "read_all", GPIO_READ_ALL },
+        { "write_mask", GPIO_WRITE_MASK },
+        { "sync_shadow", GPIO_SYNC_SHADOW },
+        { "get_event_stats", GPIO_GET_EVENT_STATS },
+        { "get_irq_stats", GPIO_GET_IRQ_STATS },
+        { "set_edge", GPIO_SET_EDGE },
+        { "set_debounce", GPIO_SET_DEBOUNCE },
+    };
+    unsigned long long *samples, t0;
+    struct gpio_config config;
+    char prefix[MAX_KEY];
+    size_t c;
+    int i;
+
+    samples = calloc(iterations, sizeof(*samples));
+    if (!samples)
+        return;
+
+    /* Eight alternating writes on the bench pin */
+    for (i = 0; i < 8; i++) {
+        batch_ops[i].op = GPIO_OP_WRITE_PIN;
+        batch_ops[i].gpio_num = BENCH_PIN;
+        batch_ops[i].value = i & 1;
+    }
+
+    printf("--- ioctl round-trip latency (%d calls each) ---\n", iterations);
+    for (c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        for (i = 0; i < iterations; i++) {
+            void *arg = ioctl_arg(cases[c].request, &config, i);
+
+            t0 = now_ns();
+            if (ioctl(fd, cases[c].request, arg) < 0) {
+                fprintf(stderr, "%s failed: %s\n", cases[c].name, strerror(errno));
+                break;
+            }
+            samples[i] = now_ns() - t0;
+        }
+        if (i < iterations)
+            continue;
+
+        snprintf(prefix, sizeof(prefix), "latency.%s", cases[c].name);
+        add_percentiles(prefix, samples, iterations);
+    }
+
+    free(samples);
+}
+
+/*
+ * Throughput, on the harness from gpio_contention.h
+ */
+
+static void bench_throughput(int fd, int max_threads, double seconds)
+{
+    struct gpio_config config;
+    char key[MAX_KEY];
+    double rate;
+    int n, i;
+
+    for (i = 0; i < NUM_PINS; i++) {
+        config.gpio_num = i;
+        config.value = GPIO_DIR_OUTPUT;
+        ioctl(fd, GPIO_SET_DIRECTION, &config);
+    }
+
+    printf("--- write_pin throughput (%.1fs per round) ---\n", seconds);
+    for (n = 1; ; n = (n * 2 < max_threads) ? n * 2 : max_threads) {
+        rate = run_round(fd, n, NUM_PINS, seconds);
+        snprintf(key, sizeof(key), "throughput.threads_%d.ops_per_sec", n);
+        add_result(key, rate);
+        printf("%3d threads %14.0f ops/s\n", n, rate);
+        if (n == max_threads)
+            break;
+    }
+}
+
+/*
+ * Edge-to-wakeup: drive EDGE_PIN through the sim backend and time until
+ * a blocked read() returns the event. The event timestamp splits this
+ * into edge-to-IRQ and IRQ-to-wakeup.
+ */
+static void bench_edge_latency(int fd, int edges)
+{
+    unsigned long long *total, *irq, *wake, t0, t1;
+    struct gpio_config config;
+    struct gpio_event event;
+    char cmd[16];
+    int sim_fd, flags, n = 0, i;
+
+    sim_fd = open(SIM_INPUTS_PATH, O_WRONLY);
+    if (sim_fd < 0) {
+        printf("--- edge-to-wakeup skipped: %s not available (load with sim=1) ---\n",
+               SIM_INPUTS_PATH);
+        return;
+    }
+
+    total = calloc(edges, sizeof(*total));
+    irq = calloc(edges, sizeof(*irq));
+    wake = calloc(edges, sizeof(*wake));
+    if (!total || !irq || !wake)
+        goto out;
+
+    config.gpio_num = EDGE_PIN;
+    config.value = GPIO_DIR_INPUT;
+    ioctl(fd, GPIO_SET_DIRECTION, &config);
+    config.value = GPIO_EDGE_BOTH;
+    ioctl(fd, GPIO_SET_EDGE, &config);
+    config.value = 0;
+    ioctl(fd, GPIO_SET_DEBOUNCE, &config);
+    config.value = GPIO_INT_ENABLE;
+    ioctl(fd, GPIO_SET_INTERRUPT, &config);
+
+    /* Drop whatever is already queued */
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    while (read(fd, &event, sizeof(event)) == sizeof(event))
+        ;
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+    for (i = 0; i < edges; i++) {
+        snprintf(cmd, sizeof(cmd), "%d %d\n", EDGE_PIN, (i + 1) & 1);
+
+        t0 = now_ns();
+        if (write(sim_fd, cmd, strlen(cmd)) < 0) {
+            perror("sim_inputs write failed");
+            break;
+        }
+        do {
+            if (read(fd, &event, sizeof(event)) != sizeof(event)) {
+                perror("event read failed");
+                goto disable;
+            }
+        } while (event.gpio_num != EDGE_PIN);
+        t1 = now_ns();
+
+        total[n] = t1 - t0;
+        irq[n] = event.timestamp_ns > t0 ? event.timestamp_ns - t0 : 0;
+        wake[n] = t1 > event.timestamp_ns ? t1 - event.timestamp_ns : 0;
+        n++;
+    }
+
+disable:
+    config.value = GPIO_INT_DISABLE;
+    ioctl(fd, GPIO_SET_INTERRUPT, &config);
+
+    if (n > 0) {
+        printf("--- edge-to-wakeup latency (%d edges) ---\n", n);
+        add_percentiles("edge.edge_to_wakeup", total, n);
+        add_percentiles("edge.edge_to_irq", irq, n);
+        add_percentiles("edge.irq_to_wakeup", wake, n);
+    }
+
+out:
+    free(total);
+    free(irq);
+    free(wake);
+    close(sim_fd);
+}
+
+/*
+ * JSON output and baseline comparison. The file is one flat object of
+ * "section.name.metric": number, one pair per line.
+ */
+
+static int write_json(const char *path)
+{
+    FILE *out = stdout;
+    int i;
+
+    if (path && strcmp(path, "-") != 0) {
+        out = fopen(path, "w");
+        if (!out) {
+            perror("Failed to open output file");
+            return -1;
+        }
+    }
+
+    fprintf(out, "{\n");
+    for (i = 0; i < num_results; i++)
+        fprintf(out, "  \"%s\": %.0f%s\n", results[i].key, results[i].value,
+                i + 1 < num_results ? "," : "");
+    fprintf(out, "}\n");
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
+
+static struct result *find_result(const char *key)
+{
+    int i;
+
+    for (i = 0; i < num_results; i++)
+        if (strcmp(results[i].key, key) == 0)
+            return &results[i];
+    return NULL;
+}
+
+/* Latencies regress when they grow, throughput when it shrinks */
+static int compare_baseline(const char *path, double threshold)
+{
+    char line[256], key[MAX_KEY];
+    struct result *cur;
+    int regressions = 0;
+    double base, delta;
+    FILE *in;
+
+    in = fopen(path, "r");
+    if (!in) {
+        perror("Failed to open baseline");
+        return -1;
+    }
+
+    printf("--- comparison against %s (threshold %.1f%%) ---\n", path, threshold);
+    while (fgets(line, sizeof(line), in)) {
+        if (sscanf(line, " \"%63[^\"]\": %lf", key, &base) != 2)
+            continue;
+
+        cur = find_result(key);
+        if (!cur || base <= 0) {
+            printf("  %-44s missing\n", key);
+            continue;
+        }
+
+        delta = (cur->value - base) * 100.0 / base;
+        if (strstr(key, "ops_per_sec"))
+            delta = -delta;
+
+        printf("  %-44s %12.0f -> %12.0f  %+7.1f%%%s\n", key, base, cur->value,
+               delta, delta > threshold ? "  REGRESSION" : "");
+        if (delta > threshold)
+            regressions++;
+    }
+    fclose(in);
+
+    printf("%d regression(s)\n", regressions);
+    return regressions;
+}
+
+static void print_usage(const char *prog_name)
+{
+    printf("Usage: %s [-n iterations] [-t max_threads] [-d seconds] [-e edges]\n", prog_name);
+    printf("          [-o results.json] [-c baseline.json] [-r threshold_pct]\n");
+    printf("  -n  Calls per ioctl for the latency run (default: 10000)\n");
+    printf("  -t  Largest thread count for the throughput run (default: %d)\n", NUM_PINS);
+    printf("  -d  Seconds per throughput round (default: 1)\n");
+    printf("  -e  Edges for the edge-to-wakeup run, needs sim=1 (default: 1000)\n");
+    printf("  -o  Write JSON results to a file, '-' for stdout\n");
+    printf("  -c  Compare against a saved baseline, exit 2 on regression\n");
+    printf("  -r  Allowed slowdown in percent before flagging (default: 10)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *output = NULL, *baseline = NULL;
+    int iterations = 10000, max_threads = NUM_PINS, edges = 1000;
+    double seconds = 1.0, threshold = 10.0;
+    int fd, opt, ret = EXIT_SUCCESS;
+
+    while ((opt = getopt(argc, argv, "n:t:d:e:o:c:r:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 'e':
+            edges = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'c':
+            baseline = optarg;
+            break;
+        case 'r':
+            threshold = atof(optarg);
+            break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (iterations < 1 || max_threads < 1 || seconds <= 0 || edges < 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    printf("=== GPIO Driver Benchmark ===\n");
+    bench_latency(fd, iterations);
+    bench_throughput(fd, max_threads, seconds);
+    if (edges > 0)
+        bench_edge_latency(fd, edges);
+    close(fd);
+
+    if (output && write_json(output) < 0)
+        ret = EXIT_FAILURE;
+
+    if (baseline) {
+        int regressions = compare_baseline(baseline, threshold);
+
+        if (regressions < 0)
+            ret = EXIT_FAILURE;
+        else if (regressions > 0)
+            ret = 2;
+    }
+
+    return ret;
+}
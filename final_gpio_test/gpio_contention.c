@@ -0,0 +1,91 @@
+/*
+ * GPIO Driver Lock Contention Benchmark
+ * Runs 1..N threads toggling pins and reports how throughput scales
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <string.h>
+#include <errno.h>
+#include "gpio_contention.h"
+
+#define DEVICE_PATH "/dev/simple_gpio0"
+#define NUM_PINS 8
+
+static void print_usage(const char *prog_name)
+{
+    printf("Usage: %s [-t max_threads] [-d seconds] [-s]\n", prog_name);
+    printf("  -t  Largest thread count to test (default: %d)\n", NUM_PINS);
+    printf("  -d  Seconds per round (default: 2)\n");
+    printf("  -s  All threads share GPIO 0 instead of one pin each\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct gpio_config config;
+    int max_threads = NUM_PINS;
+    double seconds = 2.0;
+    double base = 0, rate;
+    int shared = 0;
+    int fd, opt, n, i;
+
+    while ((opt = getopt(argc, argv, "t:d:sh")) != -1) {
+        switch (opt) {
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        case 's':
+            shared = 1;
+            break;
+        default:
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (max_threads < 1 || seconds <= 0) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < NUM_PINS; i++) {
+        config.gpio_num = i;
+        config.value = GPIO_DIR_OUTPUT;
+        if (ioctl(fd, GPIO_SET_DIRECTION, &config) < 0) {
+            perror("GPIO_SET_DIRECTION failed");
+            close(fd);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("=== GPIO Lock Contention Benchmark (%s) ===\n",
+           shared ? "shared pin" : "pin per thread");
+    printf("%8s %14s %14s %8s\n", "threads", "ops/s", "ops/s/thread", "scaling");
+
+    /* 1, 2, 4, ... and always finish with max_threads itself */
+    for (n = 1; ; n = (n * 2 < max_threads) ? n * 2 : max_threads) {
+        rate = run_round(fd, n, shared ? 1 : NUM_PINS, seconds);
+        if (n == 1)
+            base = rate;
+        printf("%8d %14.0f %14.0f %7.2fx\n",
+               n, rate, rate / n, base > 0 ? rate / base : 0.0);
+        if (n == max_threads)
+            break;
+    }
+
+    close(fd);
+    return EXIT_SUCCESS;
+}
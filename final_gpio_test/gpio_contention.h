@@ -0,0 +1,106 @@
+/*
+ * GPIO write_pin contention harness, shared by gpio_contention and
+ * gpio_bench. Needs _GNU_SOURCE for the CPU affinity calls.
+ */
+
+#ifndef GPIO_CONTENTION_H
+#define GPIO_CONTENTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "gpio_driver.h"
+
+struct worker {
+    pthread_t thread;
+    int fd;
+    int gpio_num;
+    int cpu;
+    unsigned long long ops;
+};
+
+static volatile int running;
+static volatile int started;
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker_main(void *arg)
+{
+    struct worker *w = arg;
+    struct gpio_config config;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    config.gpio_num = w->gpio_num;
+    config.value = 0;
+
+    while (!started)
+        ;
+
+    while (running) {
+        config.value ^= 1;
+        if (ioctl(w->fd, GPIO_WRITE_PIN, &config) < 0) {
+            perror("GPIO_WRITE_PIN failed");
+            break;
+        }
+        w->ops++;
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns total write_pin ops per second for nthreads pinned workers,
+ * spread over GPIOs 0..npins-1 (npins 1: all share GPIO 0)
+ */
+static double run_round(int fd, int nthreads, int npins, double seconds)
+{
+    struct worker *workers;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long total = 0;
+    double start, elapsed;
+    int i;
+
+    workers = calloc(nthreads, sizeof(*workers));
+    if (!workers)
+        return 0;
+
+    running = 1;
+    started = 0;
+
+    for (i = 0; i < nthreads; i++) {
+        workers[i].fd = fd;
+        workers[i].gpio_num = i % npins;
+        workers[i].cpu = i % ncpus;
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+
+    start = now_sec();
+    started = 1;
+    usleep((useconds_t)(seconds * 1e6));
+    running = 0;
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total += workers[i].ops;
+    }
+    elapsed = now_sec() - start;
+
+    free(workers);
+    return total / elapsed;
+}
+
+#endif /* GPIO_CONTENTION_H */
@@ -7,313 +7,4242 @@
 #include <linux/interrupt.h>
 #include <linux/uaccess.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/kfifo.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <uapi/linux/sched/types.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/jump_label.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/random.h>
+#include <linux/percpu.h>
+#include <linux/sched/clock.h>
+#include <linux/platform_device.h>
+#include <linux/of.h>
+#include <linux/idr.h>
+#include <linux/gpio/driver.h>
 #include "gpio_driver.h"
 
+#define CREATE_TRACE_POINTS
+#include "gpio_trace.h"
+
 #define DRIVER_NAME "simple_gpio"
-#define GPIO_BASE_ADDR 0x28000000
+#define GPIO_BASE_ADDR 0x28000000   /* legacy single bank */
 #define GPIO_MEM_SIZE 0x24
-#define NUM_GPIOS 8
+#define NUM_GPIOS 8                 /* pins of a bank with the default layout */
+#define GPIO_MAX_PINS 32            /* pins of any bank, one bit each in a u32 */
+#define GPIO_MAX_BANKS 16
+#define GPIO_EVENT_RING_SIZE 1024   /* records, power of two */
+#define GPIO_IRQ_LATCH_SIZE 64      /* hard-IRQ to thread hand-off, power of two */
+#define GPIO_HIST_BUCKETS 32        /* bucket n counts [2^n, 2^(n+1)) ns */
 
-/* Module parameters */
+/*
+ * Module parameters. Banks come from the device tree; without a matching
+ * node they are created from bank_base/bank_irq, or with sim from
+ * sim_banks, and with none of those it is one bank at GPIO_BASE_ADDR.
+ */
 static int gpio_irq = -1;
 module_param(gpio_irq, int, 0444);
-MODULE_PARM_DESC(gpio_irq, "GPIO interrupt number (IRQ line)");
+MODULE_PARM_DESC(gpio_irq, "GPIO interrupt number (IRQ line) of the first bank");
+
+static unsigned long bank_base[GPIO_MAX_BANKS];
+static int nr_bank_base;
+module_param_array(bank_base, ulong, &nr_bank_base, 0444);
+MODULE_PARM_DESC(bank_base, "Physical base address of each bank, default layout");
+
+static int bank_irq[GPIO_MAX_BANKS] = { [0 ... GPIO_MAX_BANKS - 1] = -1 };
+static int nr_bank_irq;
+module_param_array(bank_irq, int, &nr_bank_irq, 0444);
+MODULE_PARM_DESC(bank_irq, "Interrupt number of each bank from bank_base (default: none)");
+
+static int irq_thread_prio;
+module_param(irq_thread_prio, int, 0444);
+MODULE_PARM_DESC(irq_thread_prio, "SCHED_FIFO priority of the IRQ thread, 1-99 (default: kernel default)");
+
+static int irq_thread_cpu = -1;
+module_param(irq_thread_cpu, int, 0444);
+MODULE_PARM_DESC(irq_thread_cpu, "CPU the IRQ and its thread are bound to (default: -1, any)");
+
+static bool shadow_cache = true;
+module_param(shadow_cache, bool, 0444);
+MODULE_PARM_DESC(shadow_cache, "Keep config bits in RAM instead of reading them back (default: 1)");
+
+static bool sim;
+module_param(sim, bool, 0444);
+MODULE_PARM_DESC(sim, "Use a simulated register bank instead of the hardware (default: 0)");
+
+static int sim_banks = 1;
+module_param(sim_banks, int, 0444);
+MODULE_PARM_DESC(sim_banks, "Number of simulated banks with sim=1 (default: 1)");
 
 #define GPIO_DATA_BIT       (1 << 0)
 #define GPIO_DIR_BIT        (1 << 1)
 #define GPIO_INT_STATUS_BIT (1 << 8)
 #define GPIO_INT_ENABLE_BIT (1 << 9)
 
-static const u32 gpio_offsets[NUM_GPIOS] = {
+/* Bits we own; data and status of input pins are driven by the hardware */
+#define GPIO_CFG_MASK (GPIO_DATA_BIT | GPIO_DIR_BIT | GPIO_INT_ENABLE_BIT)
+
+/* Register layout of a bank unless its device tree node gives one */
+static const u32 gpio_default_offsets[NUM_GPIOS] = {
     0x00, 0x04, 0x08, 0x0c, 0x10, 0x14, 0x1c, 0x20
 };
 
+struct gpio_device;
+
+/* min/max/total of measured intervals */
+struct gpio_interval {
+    u64 count;
+    u64 min_ns;
+    u64 max_ns;
+    u64 total_ns;
+};
+
+/* Edge counting mode of a pin, under the pin lock */
+struct gpio_pin_counter {
+    u64 rising;
+    u64 falling;
+    u64 missed;
+    u64 last_edge_ns;
+    u64 last_rise_ns;       /* 0 until timing (re)starts */
+    struct gpio_interval width;     /* rise to fall */
+    struct gpio_interval period;    /* rise to rise */
+};
+
+/*
+ * Every pin has its own register, so each pin gets its own lock and
+ * cache line; single-pin operations on different pins never contend.
+ */
+struct gpio_pin {
+    spinlock_t lock;
+    struct gpio_device *gpio_dev;
+    u32 shadow;     /* last written GPIO_CFG_MASK bits */
+    u8 edge;        /* GPIO_EDGE_* */
+    u8 last_level;  /* level seen by the last interrupt, for edge detection */
+    bool debouncing;        /* interrupt masked until debounce_timer fires */
+    u64 debounce_ns;
+    struct hrtimer debounce_timer;
+    struct gpio_pin_counter counter;
+} ____cacheline_aligned_in_smp;
+
+/* What the hard-IRQ handler saw, bit N for GPIO N */
+struct gpio_irq_latch {
+    u64 timestamp_ns;
+    u32 pending;
+    u32 levels;
+};
+
+/* Stimulus generator modes */
+#define GPIO_STIM_OFF       0
+#define GPIO_STIM_SQUARE    1   /* fixed half period */
+#define GPIO_STIM_POISSON   2   /* exponentially distributed gaps */
+#define GPIO_STIM_BURST     3   /* fixed gap, stops after a count */
+
+#define GPIO_STIM_MIN_NS    1000
+
+/* One signal generator per simulated input, run from a hard hrtimer */
+struct gpio_sim_stim {
+    struct hrtimer timer;
+    struct gpio_device *gpio_dev;
+    u8 gpio_num;
+    u8 mode;
+    u64 interval_ns;            /* half period, mean gap or burst gap */
+    u32 remaining;              /* edges left in a burst */
+    u64 edges;                  /* edges driven onto the input */
+    u64 missed;                 /* square-wave edges lost to timer overruns */
+};
+
+/* One GPIO_SET_REFLEX slot; rules and their timers run under reflex_lock */
+struct gpio_reflex_rule {
+    struct hrtimer timer;       /* delay, then the end of a pulse */
+    struct gpio_device *gpio_dev;
+    u8 in_gpio;
+    u8 edge;                    /* GPIO_EDGE_RISING/FALLING/BOTH */
+    u8 out_gpio;
+    u8 action;
+    bool busy;                  /* timer armed for this rule */
+    bool pulse_end;             /* timer ends a pulse rather than a delay */
+    u64 delay_ns;
+    u64 pulse_ns;
+    u64 edge_ns;                /* IRQ entry time of the edge being served */
+    u64 hits;
+    u64 missed;
+    u64 lat_min_ns;
+    u64 lat_max_ns;
+    u64 lat_total_ns;
+};
+
+/* Software PWM of one pin, advanced by the bank's shared pwm_timer */
+struct gpio_pwm_chan {
+    u64 period_ns;
+    u64 duty_ns;
+    u64 next_ns;                /* scheduled time of the next transition */
+    bool high;                  /* level driven at the last transition */
+    u64 first_rise_ns;
+    u64 last_rise_ns;
+    u64 rises;
+    u64 falls;
+    u64 high_total_ns;
+    u64 late_max_ns;
+    u64 late_total_ns;
+    u64 skipped;
+};
+
+/* Logic-analyzer state; the run buffer is allocated on first use */
+struct gpio_capture {
+    struct hrtimer timer;
+    spinlock_t lock;            /* between the timer and the ioctls */
+    struct mutex mutex;         /* start, stop and buffer allocation */
+    struct gpio_capture_run *runs;
+    struct gpio_capture_config cfg;
+    u32 state;                  /* GPIO_CAPTURE_* */
+    u32 first;                  /* oldest valid run */
+    u32 nr;
+    u64 samples;
+    u64 trigger_sample;
+    u64 post_left;
+    u64 last_ns;                /* time of the newest sample */
+    u64 late_ticks;
+    bool truncated;
+};
+
+/* One sequencer state machine; lock is between its timer and the ioctls */
+struct gpio_seq {
+    struct hrtimer timer;
+    struct gpio_device *gpio_dev;
+    spinlock_t lock;
+    struct gpio_seq_insn insns[GPIO_SEQ_MAX_INSNS];
+    u32 ninsns;
+    u32 pins;                   /* pins the program touches, locked per tick */
+    u32 steps_per_tick;
+    u64 period_ns;
+    u32 state;                  /* GPIO_SEQ_* */
+    u32 pc;
+    u32 x;
+    u32 isr;
+    u32 delay;                  /* ticks left before pc runs */
+    DECLARE_KFIFO(fifo, u32, GPIO_SEQ_FIFO_SIZE);
+    u64 ticks;
+    u64 steps;
+    u64 stall_ticks;
+    u64 budget_ticks;
+    u64 late_ticks;
+    u64 fifo_overflows;
+};
+
+/*
+ * Simulated register bank: same bit semantics as the hardware, one
+ * register per pin, input levels are driven through gpio_sim_set_input().
+ */
+struct gpio_sim {
+    spinlock_t lock;
+    u32 regs[GPIO_MAX_PINS];
+    u32 inputs;                 /* external levels, bit N for GPIO N */
+    struct irq_domain *domain;
+    int irq;                    /* software-triggered bank interrupt */
+    struct mutex stim_lock;     /* serializes generator reconfiguration */
+    struct gpio_sim_stim stim[GPIO_MAX_PINS];
+};
+
+/* log2 service-time histograms, per CPU like struct gpio_stats */
+struct gpio_latency_hist {
+    u64 ioctl[GPIO_HIST_BUCKETS];
+    u64 irq[GPIO_HIST_BUCKETS];         /* hard-IRQ handler */
+    u64 irq_thread[GPIO_HIST_BUCKETS];  /* one IRQ thread wakeup */
+};
+
+/* One bank: its own registers, locks, IRQ, event ring and /dev node */
 struct gpio_device {
     struct cdev cdev;
-    struct class *class;
+    struct device *dev;     /* the platform device */
     dev_t devt;
+    int id;                 /* N of /dev/simple_gpioN */
+    struct gpio_chip chip;  /* the same pins for gpiolib users */
+    struct resource *mem;
     void __iomem *base_addr;
+    int ngpio;
+    u32 offsets[GPIO_MAX_PINS];
+    struct gpio_sim *sim;
+    struct dentry *debugfs;
     int irq;
-    spinlock_t lock;
+    spinlock_t lock;        /* serializes multi-pin operations */
+    u64 lock_taken_ns;      /* protected by lock, for the hold time stat */
+    struct gpio_pin pins[GPIO_MAX_PINS];
+    struct gpio_stats __percpu *stats;
+    struct gpio_latency_hist __percpu *hist;
+
+    /*
+     * Interrupt event ring, shared with user space through mmap().
+     * Producers are serialized by event_lock and read() callers by
+     * read_lock; the two sides only meet through head and tail.
+     */
+    struct gpio_event_ring *ring;
+    struct gpio_event *ring_data;
+    size_t ring_bytes;
+    u32 ring_head;          /* private copy, user space cannot corrupt it */
+    spinlock_t event_lock;
+    struct mutex read_lock;
+    wait_queue_head_t event_wait;
+    u64 event_seq;
+    u64 events_dropped;
+
+    /*
+     * Status bits latched by the hard-IRQ handler for the IRQ thread.
+     * One producer and one consumer, so the kfifo needs no lock.
+     */
+    DECLARE_KFIFO(irq_latches, struct gpio_irq_latch, GPIO_IRQ_LATCH_SIZE);
+    atomic_t latch_overruns;
+    bool irq_thread_ready;
+
+    /* Pins with GPIO_INT_ENABLE_BIT set, the only ones the handler scans */
+    unsigned long irq_enabled;
+    /* Pins requested as Linux IRQs, demuxed instead of queued as events */
+    unsigned long irq_claimed;
+    /* Pins in edge counting mode, counted instead of queued as events */
+    unsigned long counting;
+
+    /* Reflex rules, looked up by the hard-IRQ handler */
+    struct gpio_reflex_rule reflex[GPIO_REFLEX_MAX];
+    unsigned long reflex_active;    /* slots in use */
+    spinlock_t reflex_lock;
+    struct mutex reflex_mutex;      /* serializes GPIO_SET_REFLEX */
+
+    /* Software PWM, one channel per pin */
+    struct gpio_pwm_chan pwm[GPIO_MAX_PINS];
+    unsigned long pwm_active;       /* channels with timer edges */
+    struct hrtimer pwm_timer;
+    spinlock_t pwm_lock;
+
+    /*
+     * Paced output queue. write() fills it at out_head under write_lock,
+     * out_timer plays from out_pos; out_tail frees space as samples are
+     * played, except in loop mode where the queue stays put.
+     */
+    struct gpio_out_sample *out_buf;
+    u32 out_head;
+    u32 out_tail;
+    u32 out_pos;
+    u32 out_flags;          /* GPIO_OUT_LOOP */
+    bool out_running;
+    u64 out_next_ns;        /* scheduled time of the sample at out_pos */
+    struct hrtimer out_timer;
+    spinlock_t out_lock;
+    struct mutex write_lock;
+    wait_queue_head_t out_wait;
+    u64 out_played;
+    u64 out_underruns;
+    u64 out_rejected;
+    u64 out_late_max_ns;
+
+    struct gpio_capture capture;
+
+    struct gpio_seq seq[GPIO_SEQ_MAX];
+    struct mutex seq_mutex;         /* serializes GPIO_SEQ_LOAD_PROG */
+
+    /* Hard-IRQ counters, only ever written by the (non-reentrant) handler */
+    struct gpio_irq_stats irq_stats;
+    atomic64_t bounces_filtered;    /* debounce timers run on any CPU */
 };
 
-static struct gpio_device *gpio_dev;
+/* Shared by all banks */
+static struct class *gpio_class;
+static dev_t gpio_devt;
+static DEFINE_IDA(gpio_ida);
+static struct dentry *gpio_debugfs_root;
+static struct platform_device *gpio_param_pdevs[GPIO_MAX_BANKS];
+static int gpio_nr_param_pdevs;
+
+/* Per-CPU, so the hot paths never share a cache line for counting */
+#define gpio_pin_stat_inc(gpio_num, field) \
+    this_cpu_inc(gpio_dev->stats->pins[gpio_num].field)
+
+#define gpio_hist_add(field, ns) \
+    this_cpu_inc(gpio_dev->hist->field[min_t(int, ilog2((ns) | 1), GPIO_HIST_BUCKETS - 1)])
+
+/* Register accessors branch to the simulator only when it is loaded */
+static DEFINE_STATIC_KEY_FALSE(gpio_sim_active);
+
+static u32 gpio_sim_read(struct gpio_device *gpio_dev, int gpio_num)
+{
+    struct gpio_sim *gs = gpio_dev->sim;
+    unsigned long flags;
+    u32 reg_val;
+
+    spin_lock_irqsave(&gs->lock, flags);
+    reg_val = gs->regs[gpio_num];
+    /* Inputs read the external level, outputs what was written */
+    if (!(reg_val & GPIO_DIR_BIT)) {
+        reg_val &= ~GPIO_DATA_BIT;
+        if (gs->inputs & BIT(gpio_num))
+            reg_val |= GPIO_DATA_BIT;
+    }
+    spin_unlock_irqrestore(&gs->lock, flags);
+
+    return reg_val;
+}
+
+static void gpio_sim_fire(struct gpio_sim *gs)
+{
+#if IS_ENABLED(CONFIG_IRQ_SIM)
+    if (gs->irq > 0)
+        irq_set_irqchip_state(gs->irq, IRQCHIP_STATE_PENDING, true);
+#endif
+}
+
+static void gpio_sim_write(struct gpio_device *gpio_dev, int gpio_num, u32 value)
+{
+    struct gpio_sim *gs = gpio_dev->sim;
+    unsigned long flags;
+    bool fire;
+    u32 *reg;
+
+    spin_lock_irqsave(&gs->lock, flags);
+    reg = &gs->regs[gpio_num];
+    /* GPIO_INT_STATUS_BIT is W1TC, everything else is plain read/write */
+    fire = !(*reg & GPIO_INT_ENABLE_BIT) && (value & GPIO_INT_ENABLE_BIT);
+    value = (value & GPIO_CFG_MASK) | 
+            ((value & GPIO_INT_STATUS_BIT) ? 0 : (*reg & GPIO_INT_STATUS_BIT));
+    *reg = value;
+    /* Unmasking a pin with status still latched raises the IRQ again */
+    fire = fire && (value & GPIO_INT_STATUS_BIT);
+    spin_unlock_irqrestore(&gs->lock, flags);
+
+    if (fire)
+        gpio_sim_fire(gs);
+}
+
+/* Drive an input from outside, like a signal on the real pin would */
+static void gpio_sim_set_input(struct gpio_device *gpio_dev, int gpio_num, int level)
+{
+    struct gpio_sim *gs = gpio_dev->sim;
+    unsigned long flags;
+    bool fire = false;
+    u32 *reg;
+
+    spin_lock_irqsave(&gs->lock, flags);
+    if (!!(gs->inputs & BIT(gpio_num)) != !!level) {
+        if (level)
+            gs->inputs |= BIT(gpio_num);
+        else
+            gs->inputs &= ~BIT(gpio_num);
+
+        reg = &gs->regs[gpio_num];
+        if (!(*reg & GPIO_DIR_BIT) && (*reg & GPIO_INT_ENABLE_BIT)) {
+            fire = !(*reg & GPIO_INT_STATUS_BIT);
+            *reg |= GPIO_INT_STATUS_BIT;
+        }
+    }
+    spin_unlock_irqrestore(&gs->lock, flags);
+
+    if (fire)
+        gpio_sim_fire(gs);
+}
+
+/*
+ * Exponentially distributed gap with the given mean: -ln(U) * mean, with
+ * -ln(U) = (32 - log2(u)) * ln(2) for a uniform 32-bit u, in Q16.
+ */
+static u64 gpio_stim_exp_ns(u64 mean_ns)
+{
+    u32 u = get_random_u32() | 1;
+    int e = ilog2(u);
+    u64 x = ((u64)u << 16) >> e;    /* mantissa in [1, 2), Q16 */
+    u32 log2_q16 = e << 16;
+    u64 neg_ln_q16;
+    int i;
+
+    /* Fractional bits of log2 by repeated squaring */
+    for (i = 15; i >= 0; i--) {
+        x = (x * x) >> 16;
+        if (x >= (2 << 16)) {
+            x >>= 1;
+            log2_q16 |= 1U << i;
+        }
+    }
+
+    neg_ln_q16 = (((32ULL << 16) - log2_q16) * 45426) >> 16;  /* ln(2) in Q16 */
+    return max_t(u64, (mean_ns * neg_ln_q16) >> 16, GPIO_STIM_MIN_NS);
+}
+
+static enum hrtimer_restart gpio_stim_timer(struct hrtimer *timer)
+{
+    struct gpio_sim_stim *st = container_of(timer, struct gpio_sim_stim, timer);
+    struct gpio_device *gpio_dev = st->gpio_dev;
+    struct gpio_sim *gs = gpio_dev->sim;
+    u64 overruns;
+
+    gpio_sim_set_input(gpio_dev, st->gpio_num, 
+                       !(READ_ONCE(gs->inputs) & BIT(st->gpio_num)));
+    st->edges++;
+
+    switch (st->mode) {
+    case GPIO_STIM_SQUARE:
+        overruns = hrtimer_forward_now(timer, ns_to_ktime(st->interval_ns));
+        st->missed += overruns - 1;
+        return HRTIMER_RESTART;
+    case GPIO_STIM_POISSON:
+        hrtimer_forward_now(timer, ns_to_ktime(gpio_stim_exp_ns(st->interval_ns)));
+        return HRTIMER_RESTART;
+    case GPIO_STIM_BURST:
+        if (--st->remaining == 0)
+            break;
+        hrtimer_forward_now(timer, ns_to_ktime(st->interval_ns));
+        return HRTIMER_RESTART;
+    }
+
+    st->mode = GPIO_STIM_OFF;
+    return HRTIMER_NORESTART;
+}
+
+/* Stim lock held: (re)program one generator, GPIO_STIM_OFF stops it */
+static void __gpio_stim_set(struct gpio_device *gpio_dev, int gpio_num, u8 mode, 
+                            u64 interval_ns, u32 count)
+{
+    struct gpio_sim_stim *st = &gpio_dev->sim->stim[gpio_num];
+    u64 first;
+
+    hrtimer_cancel(&st->timer);
+    st->mode = mode;
+    st->interval_ns = interval_ns;
+    st->remaining = count;
+    st->edges = 0;
+    st->missed = 0;
+    if (mode == GPIO_STIM_OFF)
+        return;
+
+    first = mode == GPIO_STIM_POISSON ? gpio_stim_exp_ns(interval_ns) : interval_ns;
+    hrtimer_start(&st->timer, ns_to_ktime(first), HRTIMER_MODE_REL_HARD);
+}
 
-static inline u32 gpio_read_reg(int gpio_num)
+static inline u32 gpio_read_reg(struct gpio_device *gpio_dev, int gpio_num)
 {
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
         return 0;
-    return ioread32(gpio_dev->base_addr + gpio_offsets[gpio_num]);
+    if (static_branch_unlikely(&gpio_sim_active))
+        return gpio_sim_read(gpio_dev, gpio_num);
+    return ioread32(gpio_dev->base_addr + gpio_dev->offsets[gpio_num]);
 }
 
-static inline void gpio_write_reg(int gpio_num, u32 value)
+static inline void gpio_write_reg(struct gpio_device *gpio_dev, int gpio_num, u32 value)
 {
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
         return;
-    iowrite32(value, gpio_dev->base_addr + gpio_offsets[gpio_num]);
+    if (static_branch_unlikely(&gpio_sim_active)) {
+        gpio_sim_write(gpio_dev, gpio_num, value);
+        return;
+    }
+    iowrite32(value, gpio_dev->base_addr + gpio_dev->offsets[gpio_num]);
+}
+
+/* Config bits of a pin, from the shadow copy unless the cache is off */
+static inline u32 gpio_cfg_read(struct gpio_device *gpio_dev, int gpio_num)
+{
+    struct gpio_pin *pin = &gpio_dev->pins[gpio_num];
+    u32 cfg;
+
+    if (shadow_cache)
+        return pin->shadow;
+
+    cfg = gpio_read_reg(gpio_dev, gpio_num) & GPIO_CFG_MASK;
+    /* The debounce mask is ours, not part of the pin's configuration */
+    if (pin->debouncing)
+        cfg |= pin->shadow & GPIO_INT_ENABLE_BIT;
+    return cfg;
+}
+
+/* Register value for a config, a pin in its debounce window stays masked */
+static inline u32 gpio_cfg_hw(struct gpio_device *gpio_dev, int gpio_num, u32 cfg)
+{
+    if (gpio_dev->pins[gpio_num].debouncing)
+        cfg &= ~GPIO_INT_ENABLE_BIT;
+    return cfg;
+}
+
+/* The interrupt config of a claimed pin belongs to its in-kernel consumer */
+static inline bool gpio_irq_claimed(struct gpio_device *gpio_dev, int gpio_num)
+{
+    return test_bit(gpio_num, &gpio_dev->irq_claimed);
+}
+
+static inline void gpio_update_irq_enabled(struct gpio_device *gpio_dev, int gpio_num, u32 cfg)
+{
+    if (cfg & GPIO_INT_ENABLE_BIT)
+        set_bit(gpio_num, &gpio_dev->irq_enabled);
+    else
+        clear_bit(gpio_num, &gpio_dev->irq_enabled);
+}
+
+/* Write-only update; the status bit is never set so no W1TC side effect */
+static inline void gpio_cfg_write(struct gpio_device *gpio_dev, int gpio_num, u32 cfg)
+{
+    gpio_dev->pins[gpio_num].shadow = cfg;
+    gpio_update_irq_enabled(gpio_dev, gpio_num, cfg);
+    gpio_write_reg(gpio_dev, gpio_num, gpio_cfg_hw(gpio_dev, gpio_num, cfg));
 }
 
-static int gpio_set_direction(int gpio_num, int direction)
+static void __gpio_sync_shadow(struct gpio_device *gpio_dev)
 {
     u32 reg_val;
+    int i;
+
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        reg_val = gpio_read_reg(gpio_dev, i);
+        gpio_dev->pins[i].shadow = reg_val & GPIO_CFG_MASK;
+        gpio_dev->pins[i].last_level = (reg_val & GPIO_DATA_BIT) ? 1 : 0;
+        gpio_update_irq_enabled(gpio_dev, i, gpio_dev->pins[i].shadow);
+    }
+}
+
+#define gpio_all_pins(gpio_dev) GENMASK((gpio_dev)->ngpio - 1, 0)
+
+/*
+ * Multi-pin operations take gpio_dev->lock and then the lock of every pin
+ * in mask in ascending order, so they stay atomic against single-pin
+ * callers and against each other.
+ */
+static void gpio_lock_pins(struct gpio_device *gpio_dev, u32 mask, unsigned long *flags)
+{
+    u64 wait_start = trace_gpio_lock_acquire_enabled() ? local_clock() : 0;
+    int i;
+
+    spin_lock_irqsave(&gpio_dev->lock, *flags);
+    gpio_dev->lock_taken_ns = local_clock();
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        if (mask & BIT(i))
+            spin_lock_nest_lock(&gpio_dev->pins[i].lock, &gpio_dev->lock);
+    }
+    trace_gpio_lock_acquire(mask, wait_start ? gpio_dev->lock_taken_ns - wait_start : 0);
+}
+
+static void gpio_unlock_pins(struct gpio_device *gpio_dev, u32 mask, unsigned long flags)
+{
+    int i;
+
+    for (i = gpio_dev->ngpio - 1; i >= 0; i--) {
+        if (mask & BIT(i))
+            spin_unlock(&gpio_dev->pins[i].lock);
+    }
+    /* Still on the locking CPU, interrupts are off */
+    this_cpu_inc(gpio_dev->stats->lock_acquisitions);
+    this_cpu_add(gpio_dev->stats->lock_hold_ns, 
+                 local_clock() - gpio_dev->lock_taken_ns);
+    spin_unlock_irqrestore(&gpio_dev->lock, flags);
+}
+
+/*
+ * Lock-free helpers: the caller holds the pin's lock and has already
+ * validated gpio_num.
+ */
+static void __gpio_set_direction(struct gpio_device *gpio_dev, int gpio_num, int direction)
+{
+    u32 reg_val = gpio_cfg_read(gpio_dev, gpio_num);
+
+    if (!!(reg_val & GPIO_DIR_BIT) != !!direction)
+        gpio_pin_stat_inc(gpio_num, direction_changes);
+
+    if (direction)
+        reg_val |= GPIO_DIR_BIT;
+    else
+        reg_val &= ~GPIO_DIR_BIT;
+
+    gpio_cfg_write(gpio_dev, gpio_num, reg_val);
+}
+
+static int __gpio_read_pin(struct gpio_device *gpio_dev, int gpio_num)
+{
+    u32 cfg = gpio_cfg_read(gpio_dev, gpio_num);
+
+    /* Outputs read back what we drive; only inputs need the hardware */
+    if (shadow_cache && (cfg & GPIO_DIR_BIT))
+        return (cfg & GPIO_DATA_BIT) ? 1 : 0;
+
+    return (gpio_read_reg(gpio_dev, gpio_num) & GPIO_DATA_BIT) ? 1 : 0;
+}
+
+static int __gpio_write_pin(struct gpio_device *gpio_dev, int gpio_num, int value)
+{
+    u32 reg_val = gpio_cfg_read(gpio_dev, gpio_num);
+
+    if (!(reg_val & GPIO_DIR_BIT)) {
+        gpio_pin_stat_inc(gpio_num, eperm);
+        return -EPERM; /* bu if blogu pinin input oldugu casedir */
+    }
+
+    if (value)
+        reg_val |= GPIO_DATA_BIT;
+    else
+        reg_val &= ~GPIO_DATA_BIT;
+
+    gpio_cfg_write(gpio_dev, gpio_num, reg_val);
+    gpio_pin_stat_inc(gpio_num, writes);
+    return 0;
+}
+
+static void __gpio_set_interrupt(struct gpio_device *gpio_dev, int gpio_num, int enable)
+{
+    u32 reg_val = gpio_cfg_read(gpio_dev, gpio_num);
+
+    if (enable) {
+        /* Edge detection starts from the level the pin has right now */
+        if (!(reg_val & GPIO_INT_ENABLE_BIT))
+            gpio_dev->pins[gpio_num].last_level = __gpio_read_pin(gpio_dev, gpio_num);
+        reg_val |= GPIO_INT_ENABLE_BIT;
+    } else {
+        reg_val &= ~GPIO_INT_ENABLE_BIT;
+    }
+
+    gpio_cfg_write(gpio_dev, gpio_num, reg_val);
+}
+
+static int __gpio_set_edge(struct gpio_device *gpio_dev, int gpio_num, int edge)
+{
+    switch (edge) {
+    case GPIO_EDGE_RISING:
+    case GPIO_EDGE_FALLING:
+    case GPIO_EDGE_BOTH:
+    case GPIO_EDGE_LEVEL_HIGH:
+    case GPIO_EDGE_LEVEL_LOW:
+        break;
+    default:
+        gpio_pin_stat_inc(gpio_num, einval);
+        return -EINVAL;
+    }
+
+    gpio_dev->pins[gpio_num].edge = edge;
+    gpio_dev->pins[gpio_num].last_level = __gpio_read_pin(gpio_dev, gpio_num);
+    return 0;
+}
+
+/*
+ * Decide whether an interrupt at this level is one the pin asked for.
+ * Called with the pin lock held, from the hard-IRQ handler.
+ */
+static bool __gpio_edge_wanted(struct gpio_pin *pin, int level)
+{
+    int prev = pin->last_level;
+
+    pin->last_level = level;
+
+    switch (pin->edge) {
+    case GPIO_EDGE_RISING:
+        return !prev && level;
+    case GPIO_EDGE_FALLING:
+        return prev && !level;
+    case GPIO_EDGE_LEVEL_HIGH:
+        return level;
+    case GPIO_EDGE_LEVEL_LOW:
+        return !level;
+    default:
+        return true;    /* GPIO_EDGE_BOTH: every status bit is reported */
+    }
+}
+
+static inline void gpio_interval_add(struct gpio_interval *iv, u64 ns)
+{
+    if (!iv->count || ns < iv->min_ns)
+        iv->min_ns = ns;
+    if (ns > iv->max_ns)
+        iv->max_ns = ns;
+    iv->total_ns += ns;
+    iv->count++;
+}
+
+/* Pin lock held: count and time the transition from prev to level */
+static void __gpio_count_edge(struct gpio_pin *pin, int prev, int level, u64 now)
+{
+    struct gpio_pin_counter *c = &pin->counter;
+
+    c->last_edge_ns = now;
+    if (level == prev) {
+        c->rising++;
+        c->falling++;
+        c->missed++;
+        c->last_rise_ns = 0;
+        return;
+    }
+
+    if (level) {
+        c->rising++;
+        if (c->last_rise_ns)
+            gpio_interval_add(&c->period, now - c->last_rise_ns);
+        c->last_rise_ns = now;
+    } else {
+        c->falling++;
+        if (c->last_rise_ns)
+            gpio_interval_add(&c->width, now - c->last_rise_ns);
+    }
+}
+
+static int __gpio_read_int_status(struct gpio_device *gpio_dev, int gpio_num)
+{
+    return (gpio_read_reg(gpio_dev, gpio_num) & GPIO_INT_STATUS_BIT) ? 1 : 0;
+}
+
+static void __gpio_clear_int_status(struct gpio_device *gpio_dev, int gpio_num, bool in_irq)
+{
+    /* W1TC, the config bits are written back unchanged */
+    u32 cfg = gpio_cfg_read(gpio_dev, gpio_num);
+    u32 reg_val = gpio_cfg_hw(gpio_dev, gpio_num, cfg) | GPIO_INT_STATUS_BIT;
+
+    gpio_pin_stat_inc(gpio_num, irqs_cleared);
+    trace_gpio_int_clear(gpio_num, reg_val, in_irq);
+    gpio_write_reg(gpio_dev, gpio_num, reg_val);
+}
+
+static int gpio_set_direction(struct gpio_device *gpio_dev, int gpio_num, int direction)
+{
+    unsigned long flags;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    __gpio_set_direction(gpio_dev, gpio_num, direction);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+
+    return 0;
+}
+
+static int gpio_read_pin(struct gpio_device *gpio_dev, int gpio_num, int *value)
+{
+    unsigned long flags;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    *value = __gpio_read_pin(gpio_dev, gpio_num);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+    gpio_pin_stat_inc(gpio_num, reads);
+
+    return 0;
+}
+
+static int gpio_write_pin(struct gpio_device *gpio_dev, int gpio_num, int value)
+{
+    unsigned long flags;
+    int ret;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    ret = __gpio_write_pin(gpio_dev, gpio_num, value);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+
+    return ret;
+}
+
+static int gpio_set_interrupt(struct gpio_device *gpio_dev, int gpio_num, int enable)
+{
+    unsigned long flags;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+    if (gpio_irq_claimed(gpio_dev, gpio_num))
+        return -EBUSY;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    __gpio_set_interrupt(gpio_dev, gpio_num, enable);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+
+    return 0;
+}
+
+static int gpio_set_edge(struct gpio_device *gpio_dev, int gpio_num, int edge)
+{
+    unsigned long flags;
+    int ret;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+    if (gpio_irq_claimed(gpio_dev, gpio_num))
+        return -EBUSY;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    ret = __gpio_set_edge(gpio_dev, gpio_num, edge);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+
+    return ret;
+}
+
+static int gpio_set_debounce(struct gpio_device *gpio_dev, int gpio_num, int debounce_us)
+{
+    struct gpio_pin *pin;
     unsigned long flags;
 
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
         return -EINVAL;
+    if (gpio_irq_claimed(gpio_dev, gpio_num))
+        return -EBUSY;
+    if (debounce_us < 0 || debounce_us > GPIO_DEBOUNCE_MAX_US) {
+        gpio_pin_stat_inc(gpio_num, einval);
+        return -EINVAL;
+    }
+
+    pin = &gpio_dev->pins[gpio_num];
+
+    spin_lock_irqsave(&pin->lock, flags);
+    pin->debounce_ns = (u64)debounce_us * NSEC_PER_USEC;
+    spin_unlock_irqrestore(&pin->lock, flags);
+
+    if (debounce_us)
+        return 0;
+
+    /* Close a pending window now instead of waiting for the timer */
+    hrtimer_cancel(&pin->debounce_timer);
+
+    spin_lock_irqsave(&pin->lock, flags);
+    if (pin->debouncing) {
+        pin->debouncing = false;
+        gpio_write_reg(gpio_dev, gpio_num, pin->shadow | GPIO_INT_STATUS_BIT);
+    }
+    spin_unlock_irqrestore(&pin->lock, flags);
+
+    return 0;
+}
+
+static int gpio_read_int_status(struct gpio_device *gpio_dev, int gpio_num, int *status)
+{
+    unsigned long flags;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    *status = __gpio_read_int_status(gpio_dev, gpio_num);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+
+    return 0;
+}
+
+static int gpio_clear_int_status(struct gpio_device *gpio_dev, int gpio_num)
+{
+    unsigned long flags;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+    if (gpio_irq_claimed(gpio_dev, gpio_num))
+        return -EBUSY;
+
+    spin_lock_irqsave(&gpio_dev->pins[gpio_num].lock, flags);
+    __gpio_clear_int_status(gpio_dev, gpio_num, false);
+    spin_unlock_irqrestore(&gpio_dev->pins[gpio_num].lock, flags);
+
+    return 0;
+}
+
+static int gpio_read_all(struct gpio_device *gpio_dev, struct gpio_bank_state *state)
+{
+    unsigned long flags;
+    u32 reg_val, cfg;
+    int i;
+
+    memset(state, 0, sizeof(*state));
+
+    /* One read per register, all pins locked for a coherent view */
+    gpio_lock_pins(gpio_dev, gpio_all_pins(gpio_dev), &flags);
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        reg_val = gpio_read_reg(gpio_dev, i);
+        cfg = shadow_cache ? gpio_dev->pins[i].shadow : reg_val;
+        if (reg_val & GPIO_DATA_BIT)
+            state->data |= BIT(i);
+        if (cfg & GPIO_DIR_BIT)
+            state->direction |= BIT(i);
+        if (cfg & GPIO_INT_ENABLE_BIT)
+            state->int_enable |= BIT(i);
+        if (reg_val & GPIO_INT_STATUS_BIT)
+            state->int_status |= BIT(i);
+        gpio_pin_stat_inc(i, reads);
+    }
+    gpio_unlock_pins(gpio_dev, gpio_all_pins(gpio_dev), flags);
+
+    return 0;
+}
+
+static int gpio_write_mask(struct gpio_device *gpio_dev, u32 mask, u32 value)
+{
+    u32 regs[GPIO_MAX_PINS];
+    unsigned long flags;
+    int i;
+
+    if (mask & ~gpio_all_pins(gpio_dev))
+        return -EINVAL;
+
+    gpio_lock_pins(gpio_dev, mask, &flags);
+
+    /* Nothing is written unless every masked pin is an output */
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        if (!(mask & BIT(i)))
+            continue;
+        regs[i] = gpio_cfg_read(gpio_dev, i);
+        if (!(regs[i] & GPIO_DIR_BIT)) {
+            gpio_pin_stat_inc(i, eperm);
+            gpio_unlock_pins(gpio_dev, mask, flags);
+            return -EPERM;
+        }
+    }
+
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        if (!(mask & BIT(i)))
+            continue;
+        if (value & BIT(i))
+            regs[i] |= GPIO_DATA_BIT;
+        else
+            regs[i] &= ~GPIO_DATA_BIT;
+        gpio_cfg_write(gpio_dev, i, regs[i]);
+        gpio_pin_stat_inc(i, writes);
+    }
+
+    gpio_unlock_pins(gpio_dev, mask, flags);
+
+    return 0;
+}
+
+/* Reload the shadow copy, e.g. after the registers were changed behind our back */
+static int gpio_sync_shadow(struct gpio_device *gpio_dev)
+{
+    unsigned long flags;
+
+    gpio_lock_pins(gpio_dev, gpio_all_pins(gpio_dev), &flags);
+    __gpio_sync_shadow(gpio_dev);
+    gpio_unlock_pins(gpio_dev, gpio_all_pins(gpio_dev), flags);
+
+    return 0;
+}
+
+/* Run one batch record; the caller holds the lock of every pin in the batch */
+static void __gpio_batch_op(struct gpio_device *gpio_dev, struct gpio_batch_op *op)
+{
+    op->result = 0;
+
+    if (op->gpio_num < 0 || op->gpio_num >= gpio_dev->ngpio) {
+        op->result = -EINVAL;
+        return;
+    }
+
+    if (gpio_irq_claimed(gpio_dev, op->gpio_num) && 
+        (op->op == GPIO_OP_SET_INTERRUPT || op->op == GPIO_OP_CLEAR_INT_STATUS || 
+         op->op == GPIO_OP_SET_EDGE)) {
+        op->result = -EBUSY;
+        return;
+    }
+
+    switch (op->op) {
+    case GPIO_OP_SET_DIRECTION:
+        __gpio_set_direction(gpio_dev, op->gpio_num, op->value);
+        break;
+    case GPIO_OP_READ_PIN:
+        op->value = __gpio_read_pin(gpio_dev, op->gpio_num);
+        gpio_pin_stat_inc(op->gpio_num, reads);
+        break;
+    case GPIO_OP_WRITE_PIN:
+        op->result = __gpio_write_pin(gpio_dev, op->gpio_num, op->value);
+        break;
+    case GPIO_OP_SET_INTERRUPT:
+        __gpio_set_interrupt(gpio_dev, op->gpio_num, op->value);
+        break;
+    case GPIO_OP_READ_INT_STATUS:
+        op->value = __gpio_read_int_status(gpio_dev, op->gpio_num);
+        break;
+    case GPIO_OP_CLEAR_INT_STATUS:
+        __gpio_clear_int_status(gpio_dev, op->gpio_num, false);
+        break;
+    case GPIO_OP_SET_EDGE:
+        op->result = __gpio_set_edge(gpio_dev, op->gpio_num, op->value);
+        break;
+    default:
+        op->result = -EINVAL;
+        break;
+    }
+}
+
+static int gpio_batch(struct gpio_device *gpio_dev, struct gpio_batch __user *ubatch)
+{
+    struct gpio_batch batch;
+    struct gpio_batch_op *ops;
+    struct gpio_batch_op __user *uops;
+    unsigned long flags;
+    u32 mask = 0;
+    u32 i;
+    int ret = 0;
+
+    if (copy_from_user(&batch, ubatch, sizeof(batch)))
+        return -EFAULT;
+
+    if (batch.flags & ~GPIO_BATCH_STOP_ON_ERROR)
+        return -EINVAL;
+    if (batch.count == 0)
+        return 0;
+    if (batch.count > GPIO_BATCH_MAX)
+        return -E2BIG;
+
+    uops = u64_to_user_ptr(batch.ops);
+    ops = memdup_user(uops, batch.count * sizeof(*ops));
+    if (IS_ERR(ops))
+        return PTR_ERR(ops);
+
+    for (i = 0; i < batch.count; i++) {
+        if (ops[i].gpio_num >= 0 && ops[i].gpio_num < gpio_dev->ngpio)
+            mask |= BIT(ops[i].gpio_num);
+    }
+
+    gpio_lock_pins(gpio_dev, mask, &flags);
+    for (i = 0; i < batch.count; i++) {
+        __gpio_batch_op(gpio_dev, &ops[i]);
+        if (ops[i].result && (batch.flags & GPIO_BATCH_STOP_ON_ERROR))
+            break;
+    }
+    gpio_unlock_pins(gpio_dev, mask, flags);
+
+    /* Records after a stop are reported as not executed */
+    for (i++; i < batch.count; i++)
+        ops[i].result = -ECANCELED;
+
+    if (copy_to_user(uops, ops, batch.count * sizeof(*ops)))
+        ret = -EFAULT;
+
+    kfree(ops);
+    return ret;
+}
+
+/*
+ * Bit-banged transfers. The line helpers run with the locks of the bus
+ * pins held; edges are spaced by busy-waiting on a deadline that is
+ * restarted with every lock hold, so time spent outside the lock is not
+ * caught up with a burst of short bits. SPI and I2C hold the lock for one
+ * bit, their clock idles in between; a UART frame has no clock and is
+ * sent or received in one hold. The bank lock is not taken, other pins
+ * stay usable during a transfer.
+ */
+struct gpio_xfer_bus {
+    struct gpio_device *gpio_dev;
+    u32 mask;             /* pins of the bus */
+    u32 half_ns;
+    u64 deadline;
+};
+
+static inline void gpio_xfer_start(struct gpio_xfer_bus *bus)
+{
+    bus->deadline = ktime_get_ns();
+}
+
+static inline void gpio_xfer_wait(struct gpio_xfer_bus *bus, u32 ns)
+{
+    bus->deadline += ns;
+    while (ktime_get_ns() < bus->deadline)
+        cpu_relax();
+}
+
+/*
+ * Bus pins only, without gpio_dev->lock. Ascending order like
+ * gpio_lock_pins(), so the two cannot deadlock; at most four pins, each
+ * in its own lockdep subclass.
+ */
+static void gpio_xfer_lock(struct gpio_xfer_bus *bus, unsigned long *flags)
+{
+    struct gpio_device *gpio_dev = bus->gpio_dev;
+    int i, n = 0;
+
+    local_irq_save(*flags);
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        if (bus->mask & BIT(i))
+            spin_lock_nested(&gpio_dev->pins[i].lock, n++);
+    }
+    gpio_xfer_start(bus);
+}
+
+static void gpio_xfer_unlock(struct gpio_xfer_bus *bus, unsigned long flags)
+{
+    struct gpio_device *gpio_dev = bus->gpio_dev;
+    int i;
+
+    for (i = gpio_dev->ngpio - 1; i >= 0; i--) {
+        if (bus->mask & BIT(i))
+            spin_unlock(&gpio_dev->pins[i].lock);
+    }
+    local_irq_restore(flags);
+}
+
+static inline void __gpio_xfer_set(struct gpio_xfer_bus *bus, int gpio_num, int level)
+{
+    u32 cfg = gpio_cfg_read(bus->gpio_dev, gpio_num);
+
+    cfg = level ? cfg | GPIO_DATA_BIT : cfg & ~GPIO_DATA_BIT;
+    gpio_cfg_write(bus->gpio_dev, gpio_num, cfg);
+}
+
+/* Open drain: 0 pulls the line low, 1 releases it to the pull-up */
+static inline void __gpio_xfer_od(struct gpio_xfer_bus *bus, int gpio_num, int level)
+{
+    u32 cfg = gpio_cfg_read(bus->gpio_dev, gpio_num) & ~GPIO_DATA_BIT;
+
+    cfg = level ? cfg & ~GPIO_DIR_BIT : cfg | GPIO_DIR_BIT;
+    gpio_cfg_write(bus->gpio_dev, gpio_num, cfg);
+}
+
+static inline int __gpio_xfer_get(struct gpio_xfer_bus *bus, int gpio_num)
+{
+    return (gpio_read_reg(bus->gpio_dev, gpio_num) & GPIO_DATA_BIT) ? 1 : 0;
+}
+
+static int gpio_xfer_spi(struct gpio_xfer_bus *bus, struct gpio_xfer *x, 
+                         const u8 *tx, u8 *rx)
+{
+    int sck = x->pins[0], mosi = x->pins[1], miso = x->pins[2], cs = x->pins[3];
+    int cpol = !!(x->flags & GPIO_XFER_CPOL);
+    bool cpha = x->flags & GPIO_XFER_CPHA;
+    unsigned long flags;
+    u32 i;
+    int b;
+
+    for (i = 0; i < x->tx_len; i++) {
+        u8 out = tx[i], in = 0;
+
+        for (b = 0; b < 8; b++) {
+            int shift = (x->flags & GPIO_XFER_LSB_FIRST) ? b : 7 - b;
+            int bit = (out >> shift) & 1;
+            int sample;
+
+            gpio_xfer_lock(bus, &flags);
+            if (i == 0 && b == 0 && cs != GPIO_XFER_NO_PIN) {
+                __gpio_xfer_set(bus, cs, 0);
+                gpio_xfer_wait(bus, bus->half_ns);
+            }
+            /* Mode 0/2 set up data before the leading edge, 1/3 on it */
+            if (cpha)
+                __gpio_xfer_set(bus, sck, !cpol);
+            __gpio_xfer_set(bus, mosi, bit);
+            gpio_xfer_wait(bus, bus->half_ns);
+            __gpio_xfer_set(bus, sck, cpha ? cpol : !cpol);
+            sample = miso != GPIO_XFER_NO_PIN ? __gpio_xfer_get(bus, miso) : 0;
+            gpio_xfer_wait(bus, bus->half_ns);
+            if (!cpha)
+                __gpio_xfer_set(bus, sck, cpol);
+            if (i == x->tx_len - 1 && b == 7 && cs != GPIO_XFER_NO_PIN) {
+                gpio_xfer_wait(bus, bus->half_ns);
+                __gpio_xfer_set(bus, cs, 1);
+            }
+            gpio_xfer_unlock(bus, flags);
+            in |= sample << shift;
+        }
+
+        if (rx)
+            rx[i] = in;
+        x->tx_done = x->rx_done = i + 1;
+        cond_resched();
+    }
+
+    return 0;
+}
+
+/* Let SCL go high and wait for a slave that stretches the clock */
+static int __gpio_xfer_scl_high(struct gpio_xfer_bus *bus, int scl)
+{
+    u64 limit;
+
+    __gpio_xfer_od(bus, scl, 1);
+    if (__gpio_xfer_get(bus, scl))
+        return 0;
+
+    limit = ktime_get_ns() + GPIO_XFER_MAX_STRETCH_NS;
+    while (!__gpio_xfer_get(bus, scl)) {
+        if (ktime_get_ns() > limit)
+            return -ETIMEDOUT;
+        cpu_relax();
+    }
+    /* The low phase ran long, time the high phase from here */
+    bus->deadline = ktime_get_ns();
+    return 0;
+}
+
+/* One clock with SDA driven to level, returns SDA as sampled with SCL high */
+static int gpio_xfer_i2c_bit(struct gpio_xfer_bus *bus, int sda, int scl, int level)
+{
+    unsigned long flags;
+    int ret;
+
+    gpio_xfer_lock(bus, &flags);
+    __gpio_xfer_od(bus, sda, level);
+    gpio_xfer_wait(bus, bus->half_ns);
+    ret = __gpio_xfer_scl_high(bus, scl);
+    if (!ret) {
+        ret = __gpio_xfer_get(bus, sda);
+        gpio_xfer_wait(bus, bus->half_ns);
+        __gpio_xfer_od(bus, scl, 0);
+    }
+    gpio_xfer_unlock(bus, flags);
+
+    return ret;
+}
+
+/* Clock out a byte and return the ACK bit, 0 when acknowledged */
+static int gpio_xfer_i2c_write(struct gpio_xfer_bus *bus, int sda, int scl, u8 byte)
+{
+    int b, ret;
+
+    for (b = 7; b >= 0; b--) {
+        ret = gpio_xfer_i2c_bit(bus, sda, scl, (byte >> b) & 1);
+        if (ret < 0)
+            return ret;
+    }
+
+    /* SDA is released to the slave for the ACK clock */
+    return gpio_xfer_i2c_bit(bus, sda, scl, 1);
+}
+
+static int gpio_xfer_i2c_read(struct gpio_xfer_bus *bus, int sda, int scl, 
+                              u8 *byte, bool ack)
+{
+    int b, ret;
+    u8 in = 0;
+
+    for (b = 7; b >= 0; b--) {
+        ret = gpio_xfer_i2c_bit(bus, sda, scl, 1);
+        if (ret < 0)
+            return ret;
+        in |= ret << b;
+    }
+
+    ret = gpio_xfer_i2c_bit(bus, sda, scl, !ack);
+    if (ret < 0)
+        return ret;
+
+    *byte = in;
+    return 0;
+}
+
+/* (Repeated) start with SCL high, leaves SCL low */
+static int gpio_xfer_i2c_start(struct gpio_xfer_bus *bus, int sda, int scl)
+{
+    unsigned long flags;
+    int ret;
+
+    gpio_xfer_lock(bus, &flags);
+    __gpio_xfer_od(bus, sda, 1);
+    gpio_xfer_wait(bus, bus->half_ns);
+    ret = __gpio_xfer_scl_high(bus, scl);
+    if (!ret) {
+        gpio_xfer_wait(bus, bus->half_ns);
+        __gpio_xfer_od(bus, sda, 0);
+        gpio_xfer_wait(bus, bus->half_ns);
+        __gpio_xfer_od(bus, scl, 0);
+    }
+    gpio_xfer_unlock(bus, flags);
+
+    return ret;
+}
+
+static void gpio_xfer_i2c_stop(struct gpio_xfer_bus *bus, int sda, int scl)
+{
+    unsigned long flags;
+
+    gpio_xfer_lock(bus, &flags);
+    __gpio_xfer_od(bus, sda, 0);
+    gpio_xfer_wait(bus, bus->half_ns);
+    __gpio_xfer_scl_high(bus, scl);
+    gpio_xfer_wait(bus, bus->half_ns);
+    __gpio_xfer_od(bus, sda, 1);
+    gpio_xfer_wait(bus, bus->half_ns);
+    gpio_xfer_unlock(bus, flags);
+}
+
+/* SCL stays low between bits, which the slave sees as a slow clock */
+static int gpio_xfer_i2c(struct gpio_xfer_bus *bus, struct gpio_xfer *x, 
+                         const u8 *tx, u8 *rx)
+{
+    int sda = x->pins[0], scl = x->pins[1];
+    u32 total = x->tx_len + x->rx_len;
+    u32 i;
+    int ret = 0;
+
+    for (i = 0; i < total && !ret; i++) {
+        bool reading = i >= x->tx_len;
+
+        if (i == 0 || i == x->tx_len) {
+            ret = gpio_xfer_i2c_start(bus, sda, scl);
+            if (!ret)
+                ret = gpio_xfer_i2c_write(bus, sda, scl, 
+                                          (x->addr << 1) | reading);
+            if (ret == 1)
+                ret = -ENXIO;
+        }
+
+        if (!ret && !reading) {
+            ret = gpio_xfer_i2c_write(bus, sda, scl, tx[i]);
+            if (ret == 1)
+                ret = -EIO;
+            else if (!ret)
+                x->tx_done++;
+        } else if (!ret) {
+            ret = gpio_xfer_i2c_read(bus, sda, scl, &rx[i - x->tx_len], 
+                                     i != total - 1);
+            if (!ret)
+                x->rx_done++;
+        }
+        cond_resched();
+    }
+
+    /* A failed transfer still releases the bus */
+    if (total)
+        gpio_xfer_i2c_stop(bus, sda, scl);
+
+    return ret;
+}
+
+static int gpio_xfer_uart(struct gpio_xfer_bus *bus, struct gpio_xfer *x, 
+                          const u8 *tx, u8 *rx)
+{
+    int txd = x->pins[0], rxd = x->pins[1];
+    u32 bit_ns = 2 * bus->half_ns;
+    unsigned long flags;
+    u64 timeout;
+    u32 i;
+    int b;
+
+    for (i = 0; i < x->tx_len; i++) {
+        u16 frame = (tx[i] << 1) | BIT(9);      /* start 0, 8 data, stop 1 */
+
+        gpio_xfer_lock(bus, &flags);
+        for (b = 0; b < 10; b++) {
+            __gpio_xfer_set(bus, txd, (frame >> b) & 1);
+            gpio_xfer_wait(bus, bit_ns);
+        }
+        gpio_xfer_unlock(bus, flags);
+        x->tx_done++;
+        cond_resched();
+    }
+
+    for (i = 0; i < x->rx_len; i++) {
+        u8 in = 0;
+        int stop;
+
+        /* Poll for the start bit with interrupts on */
+        timeout = ktime_get_ns() + (u64)x->timeout_us * NSEC_PER_USEC;
+        for (;;) {
+            gpio_xfer_lock(bus, &flags);
+            if (!__gpio_xfer_get(bus, rxd))
+                break;
+            gpio_xfer_unlock(bus, flags);
+            if (ktime_get_ns() > timeout)
+                return -ETIMEDOUT;
+            if (signal_pending(current))
+                return -EINTR;
+            cond_resched();
+        }
+
+        /* Sample in the middle of each bit */
+        gpio_xfer_wait(bus, bus->half_ns);
+        for (b = 0; b < 8; b++) {
+            gpio_xfer_wait(bus, bit_ns);
+            in |= __gpio_xfer_get(bus, rxd) << b;
+        }
+        gpio_xfer_wait(bus, bit_ns);
+        stop = __gpio_xfer_get(bus, rxd);
+        gpio_xfer_unlock(bus, flags);
+
+        if (!stop)
+            return -EIO;        /* framing error */
+        rx[i] = in;
+        x->rx_done++;
+        cond_resched();
+    }
+
+    return 0;
+}
+
+/* Put the bus pins in their idle state before the first byte */
+static void gpio_xfer_idle(struct gpio_xfer_bus *bus, struct gpio_xfer *x)
+{
+    struct gpio_device *gpio_dev = bus->gpio_dev;
+    unsigned long flags;
+
+    gpio_xfer_lock(bus, &flags);
+    switch (x->protocol) {
+    case GPIO_XFER_SPI:
+        __gpio_xfer_set(bus, x->pins[0], !!(x->flags & GPIO_XFER_CPOL));
+        __gpio_set_direction(gpio_dev, x->pins[0], 1);
+        __gpio_set_direction(gpio_dev, x->pins[1], 1);
+        if (x->pins[2] != GPIO_XFER_NO_PIN)
+            __gpio_set_direction(gpio_dev, x->pins[2], 0);
+        if (x->pins[3] != GPIO_XFER_NO_PIN) {
+            __gpio_xfer_set(bus, x->pins[3], 1);
+            __gpio_set_direction(gpio_dev, x->pins[3], 1);
+        }
+        break;
+    case GPIO_XFER_I2C:
+        __gpio_xfer_od(bus, x->pins[0], 1);
+        __gpio_xfer_od(bus, x->pins[1], 1);
+        break;
+    case GPIO_XFER_UART:
+        if (x->pins[0] != GPIO_XFER_NO_PIN) {
+            __gpio_xfer_set(bus, x->pins[0], 1);
+            __gpio_set_direction(gpio_dev, x->pins[0], 1);
+        }
+        if (x->pins[1] != GPIO_XFER_NO_PIN)
+            __gpio_set_direction(gpio_dev, x->pins[1], 0);
+        break;
+    }
+    gpio_xfer_unlock(bus, flags);
+}
+
+/* SPI may run without MISO or CS, UART without the line it does not use */
+static bool gpio_xfer_pin_optional(struct gpio_xfer *x, int i)
+{
+    if (x->protocol == GPIO_XFER_SPI)
+        return i >= 2;
+    if (x->protocol == GPIO_XFER_UART)
+        return i == 0 ? !x->tx_len : !x->rx_len;
+    return false;
+}
+
+static int gpio_xfer_pins(struct gpio_device *gpio_dev, struct gpio_xfer *x, u32 *mask)
+{
+    int npins = x->protocol == GPIO_XFER_SPI ? 4 : 2;
+    int i;
+
+    *mask = 0;
+    for (i = 0; i < npins; i++) {
+        int pin = x->pins[i];
+
+        if (pin == GPIO_XFER_NO_PIN && gpio_xfer_pin_optional(x, i))
+            continue;
+        if (pin >= gpio_dev->ngpio || (*mask & BIT(pin)))
+            return -EINVAL;
+        if (gpio_irq_claimed(gpio_dev, pin) || test_bit(pin, &gpio_dev->pwm_active))
+            return -EBUSY;
+        *mask |= BIT(pin);
+    }
+
+    return 0;
+}
+
+static int gpio_xfer(struct gpio_device *gpio_dev, struct gpio_xfer __user *ux)
+{
+    struct gpio_xfer_bus bus = { .gpio_dev = gpio_dev };
+    struct gpio_xfer x;
+    u8 *tx = NULL, *rx = NULL;
+    u64 start, bits;
+    u32 rx_len;
+    int ret;
+
+    if (copy_from_user(&x, ux, sizeof(x)))
+        return -EFAULT;
+
+    if (x.protocol < GPIO_XFER_SPI || x.protocol > GPIO_XFER_UART)
+        return -EINVAL;
+    if (x.flags & ~(GPIO_XFER_CPOL | GPIO_XFER_CPHA | GPIO_XFER_LSB_FIRST) || 
+        (x.flags && x.protocol != GPIO_XFER_SPI))
+        return -EINVAL;
+    if (x.period_ns < GPIO_XFER_MIN_PERIOD_NS || x.period_ns > GPIO_XFER_MAX_PERIOD_NS)
+        return -EINVAL;
+    if (x.protocol == GPIO_XFER_UART && x.period_ns > GPIO_XFER_UART_MAX_PERIOD_NS)
+        return -EINVAL;
+    if (x.protocol == GPIO_XFER_I2C && x.addr > 0x7f)
+        return -EINVAL;
+    if (x.timeout_us > GPIO_XFER_MAX_TIMEOUT_US)
+        return -EINVAL;
+    if (x.protocol == GPIO_XFER_SPI)
+        x.rx_len = 0;
+    if (x.tx_len > GPIO_XFER_MAX || x.rx_len > GPIO_XFER_MAX)
+        return -E2BIG;
+
+    ret = gpio_xfer_pins(gpio_dev, &x, &bus.mask);
+    if (ret)
+        return ret;
+
+    rx_len = x.protocol == GPIO_XFER_SPI ? (x.rx_buf ? x.tx_len : 0) : x.rx_len;
+    if (rx_len && !x.rx_buf)
+        return -EINVAL;
+
+    if (x.tx_len) {
+        tx = memdup_user(u64_to_user_ptr(x.tx_buf), x.tx_len);
+        if (IS_ERR(tx))
+            return PTR_ERR(tx);
+    }
+    if (rx_len) {
+        rx = kmalloc(rx_len, GFP_KERNEL);
+        if (!rx) {
+            kfree(tx);
+            return -ENOMEM;
+        }
+    }
+
+    bus.half_ns = x.period_ns / 2;
+    x.tx_done = x.rx_done = 0;
+    gpio_xfer_idle(&bus, &x);
+
+    start = ktime_get_ns();
+    switch (x.protocol) {
+    case GPIO_XFER_SPI:
+        ret = gpio_xfer_spi(&bus, &x, tx, rx);
+        if (!rx)
+            x.rx_done = 0;
+        break;
+    case GPIO_XFER_I2C:
+        ret = gpio_xfer_i2c(&bus, &x, tx, rx);
+        break;
+    default:
+        ret = gpio_xfer_uart(&bus, &x, tx, rx);
+        break;
+    }
+    x.duration_ns = ktime_get_ns() - start;
+
+    /* SPI moves both directions on the same clocks */
+    bits = 8ULL * (x.protocol == GPIO_XFER_SPI ? x.tx_done : x.tx_done + x.rx_done);
+    x.bit_rate = x.duration_ns ? div64_u64(bits * NSEC_PER_SEC, x.duration_ns) : 0;
+
+    if (x.rx_done && copy_to_user(u64_to_user_ptr(x.rx_buf), rx, x.rx_done))
+        ret = -EFAULT;
+    else if (copy_to_user(ux, &x, sizeof(x)))
+        ret = -EFAULT;
+
+    kfree(rx);
+    kfree(tx);
+    return ret;
+}
+
+static int gpio_event_ring_alloc(struct gpio_device *gpio_dev)
+{
+    struct gpio_event_ring *ring;
+    size_t data_offset = PAGE_ALIGN(sizeof(*ring));
+
+    BUILD_BUG_ON_NOT_POWER_OF_2(GPIO_EVENT_RING_SIZE);
+
+    gpio_dev->ring_bytes = PAGE_ALIGN(data_offset + 
+                           GPIO_EVENT_RING_SIZE * sizeof(struct gpio_event));
+    ring = vmalloc_user(gpio_dev->ring_bytes);
+    if (!ring)
+        return -ENOMEM;
+
+    ring->magic = GPIO_EVENT_RING_MAGIC;
+    ring->version = GPIO_EVENT_RING_VERSION;
+    ring->size = GPIO_EVENT_RING_SIZE;
+    ring->record_size = sizeof(struct gpio_event);
+    ring->data_offset = data_offset;
+
+    gpio_dev->ring = ring;
+    gpio_dev->ring_data = (void *)ring + data_offset;
+    return 0;
+}
+
+/* Records ready for the consumer; a corrupted tail counts as empty */
+static u32 gpio_event_ring_avail(u32 head, u32 tail)
+{
+    u32 avail = head - tail;
+
+    return avail <= GPIO_EVENT_RING_SIZE ? avail : 0;
+}
+
+/* Queue one event for read()/mmap; a full ring counts a drop instead */
+static void gpio_event_push(struct gpio_device *gpio_dev, int gpio_num, int value, 
+                            u64 timestamp_ns)
+{
+    struct gpio_event_ring *ring = gpio_dev->ring;
+    struct gpio_event *ev;
+    unsigned long flags;
+    u32 head, tail;
+
+    spin_lock_irqsave(&gpio_dev->event_lock, flags);
+    head = gpio_dev->ring_head;
+    /* Pairs with the consumer's release store: its reads of the slot are done */
+    tail = smp_load_acquire(&ring->tail);
+
+    if (head - tail >= GPIO_EVENT_RING_SIZE) {
+        gpio_dev->events_dropped++;
+        WRITE_ONCE(ring->dropped, gpio_dev->events_dropped);
+        gpio_dev->event_seq++;
+    } else {
+        ev = &gpio_dev->ring_data[head & (GPIO_EVENT_RING_SIZE - 1)];
+        ev->timestamp_ns = timestamp_ns;
+        ev->seq = gpio_dev->event_seq++;
+        ev->gpio_num = gpio_num;
+        ev->value = value;
+        gpio_dev->ring_head = ++head;
+        /* Record contents must be visible before the new head */
+        smp_store_release(&ring->head, head);
+    }
+    WRITE_ONCE(ring->produced, gpio_dev->event_seq);
+    spin_unlock_irqrestore(&gpio_dev->event_lock, flags);
+
+    wake_up_interruptible_poll(&gpio_dev->event_wait, EPOLLIN | EPOLLRDNORM);
+}
+
+static bool gpio_event_ring_empty(struct gpio_device *gpio_dev)
+{
+    struct gpio_event_ring *ring = gpio_dev->ring;
+
+    /* A corrupted tail reads as non-empty so read() gets to resync it */
+    return smp_load_acquire(&ring->head) == READ_ONCE(ring->tail);
+}
+
+static int gpio_get_event_stats(struct gpio_device *gpio_dev, struct gpio_event_stats *stats)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&gpio_dev->event_lock, flags);
+    stats->produced = gpio_dev->event_seq;
+    stats->dropped = gpio_dev->events_dropped;
+    /* Whole latches lost before dispatch also count as dropped events */
+    stats->dropped += atomic_read(&gpio_dev->latch_overruns);
+    stats->queued = gpio_event_ring_avail(gpio_dev->ring_head, 
+                                          READ_ONCE(gpio_dev->ring->tail));
+    stats->capacity = GPIO_EVENT_RING_SIZE;
+    spin_unlock_irqrestore(&gpio_dev->event_lock, flags);
+
+    return 0;
+}
+
+/* Hand one accepted interrupt to the consumers */
+static void gpio_dispatch_event(struct gpio_device *gpio_dev, int gpio_num, int value, 
+                                u64 timestamp_ns)
+{
+    gpio_event_push(gpio_dev, gpio_num, value, timestamp_ns);
+    pr_debug_ratelimited("GPIO%d: Interrupt detected (value=%d)\n", 
+                         gpio_num + 1, value);
+}
+
+/*
+ * Apply a GPIO_REFLEX_* action to an output from hard-IRQ or hard-timer
+ * context, false if the pin is not an output.
+ */
+static bool gpio_irq_drive(struct gpio_device *gpio_dev, int gpio_num, u8 action)
+{
+    struct gpio_pin *pin = &gpio_dev->pins[gpio_num];
+    u32 cfg;
+
+    spin_lock(&pin->lock);
+    cfg = gpio_cfg_read(gpio_dev, gpio_num);
+    if (!(cfg & GPIO_DIR_BIT)) {
+        spin_unlock(&pin->lock);
+        return false;
+    }
+
+    switch (action) {
+    case GPIO_REFLEX_SET:
+    case GPIO_REFLEX_PULSE:
+        cfg |= GPIO_DATA_BIT;
+        break;
+    case GPIO_REFLEX_CLEAR:
+        cfg &= ~GPIO_DATA_BIT;
+        break;
+    case GPIO_REFLEX_TOGGLE:
+        cfg ^= GPIO_DATA_BIT;
+        break;
+    }
+
+    gpio_cfg_write(gpio_dev, gpio_num, cfg);
+    spin_unlock(&pin->lock);
+    gpio_pin_stat_inc(gpio_num, writes);
+    return true;
+}
+
+/* Reflex lock held: act on one rule, true if a pulse has to be ended later */
+static bool __gpio_reflex_fire(struct gpio_device *gpio_dev, struct gpio_reflex_rule *r)
+{
+    u64 lat;
+
+    if (!gpio_irq_drive(gpio_dev, r->out_gpio, r->action)) {
+        r->missed++;
+        return false;
+    }
+
+    lat = ktime_get_ns() - r->edge_ns;
+    lat = lat > r->delay_ns ? lat - r->delay_ns : 0;
+    if (!r->hits || lat < r->lat_min_ns)
+        r->lat_min_ns = lat;
+    if (lat > r->lat_max_ns)
+        r->lat_max_ns = lat;
+    r->lat_total_ns += lat;
+    r->hits++;
+
+    return r->action == GPIO_REFLEX_PULSE;
+}
+
+static enum hrtimer_restart gpio_reflex_timer(struct hrtimer *timer)
+{
+    struct gpio_reflex_rule *r = container_of(timer, struct gpio_reflex_rule, timer);
+    struct gpio_device *gpio_dev = r->gpio_dev;
+    enum hrtimer_restart ret = HRTIMER_NORESTART;
+    unsigned long flags;
+
+    spin_lock_irqsave(&gpio_dev->reflex_lock, flags);
+    if (r->pulse_end) {
+        gpio_irq_drive(gpio_dev, r->out_gpio, GPIO_REFLEX_CLEAR);
+        r->pulse_end = false;
+    } else if (__gpio_reflex_fire(gpio_dev, r)) {
+        r->pulse_end = true;
+        hrtimer_forward_now(timer, ns_to_ktime(r->pulse_ns));
+        ret = HRTIMER_RESTART;
+    }
+    r->busy = ret == HRTIMER_RESTART;
+    spin_unlock_irqrestore(&gpio_dev->reflex_lock, flags);
+
+    return ret;
+}
+
+/*
+ * Hard IRQ: run the rules watching gpio_num. level == prev means the pin
+ * went both ways since the last interrupt, which matches either edge.
+ */
+static void gpio_reflex_run(struct gpio_device *gpio_dev, int gpio_num, int prev, 
+                            int level, u64 edge_ns)
+{
+    struct gpio_reflex_rule *r;
+    u8 edge;
+    int i;
+
+    if (level == prev)
+        edge = GPIO_EDGE_BOTH;
+    else
+        edge = level ? GPIO_EDGE_RISING : GPIO_EDGE_FALLING;
+
+    spin_lock(&gpio_dev->reflex_lock);
+    for_each_set_bit(i, &gpio_dev->reflex_active, GPIO_REFLEX_MAX) {
+        r = &gpio_dev->reflex[i];
+        if (r->in_gpio != gpio_num || !(r->edge & edge))
+            continue;
+        if (r->busy) {
+            r->missed++;
+            continue;
+        }
+
+        r->edge_ns = edge_ns;
+        if (r->delay_ns) {
+            r->busy = true;
+            hrtimer_start(&r->timer, ns_to_ktime(r->delay_ns), HRTIMER_MODE_REL_HARD);
+        } else if (__gpio_reflex_fire(gpio_dev, r)) {
+            r->busy = true;
+            r->pulse_end = true;
+            hrtimer_start(&r->timer, ns_to_ktime(r->pulse_ns), HRTIMER_MODE_REL_HARD);
+        }
+    }
+    spin_unlock(&gpio_dev->reflex_lock);
+}
+
+static int gpio_set_reflex(struct gpio_device *gpio_dev, const struct gpio_reflex *rx)
+{
+    struct gpio_reflex_rule *r;
+    unsigned long flags;
+
+    if (rx->index >= GPIO_REFLEX_MAX)
+        return -EINVAL;
+    if (rx->action != GPIO_REFLEX_OFF) {
+        if (rx->in_gpio >= (u32)gpio_dev->ngpio || rx->out_gpio >= (u32)gpio_dev->ngpio || 
+            rx->action > GPIO_REFLEX_PULSE)
+            return -EINVAL;
+        if (!rx->edge || (rx->edge & ~GPIO_EDGE_BOTH))
+            return -EINVAL;
+        if (rx->delay_us > GPIO_REFLEX_MAX_US || rx->pulse_us > GPIO_REFLEX_MAX_US || 
+            (rx->action == GPIO_REFLEX_PULSE && !rx->pulse_us))
+            return -EINVAL;
+        if (gpio_irq_claimed(gpio_dev, rx->in_gpio))
+            return -EBUSY;
+    }
+
+    r = &gpio_dev->reflex[rx->index];
+    mutex_lock(&gpio_dev->reflex_mutex);
+
+    /* Hide the slot from the handler, then wait out its timer */
+    spin_lock_irqsave(&gpio_dev->reflex_lock, flags);
+    clear_bit(rx->index, &gpio_dev->reflex_active);
+    spin_unlock_irqrestore(&gpio_dev->reflex_lock, flags);
+    hrtimer_cancel(&r->timer);
+
+    /* An output caught mid-pulse keeps its level */
+    if (rx->action != GPIO_REFLEX_OFF) {
+        spin_lock_irqsave(&gpio_dev->reflex_lock, flags);
+        r->in_gpio = rx->in_gpio;
+        r->edge = rx->edge;
+        r->out_gpio = rx->out_gpio;
+        r->action = rx->action;
+        r->delay_ns = (u64)rx->delay_us * NSEC_PER_USEC;
+        r->pulse_ns = (u64)rx->pulse_us * NSEC_PER_USEC;
+        r->busy = false;
+        r->pulse_end = false;
+        r->hits = 0;
+        r->missed = 0;
+        r->lat_min_ns = 0;
+        r->lat_max_ns = 0;
+        r->lat_total_ns = 0;
+        set_bit(rx->index, &gpio_dev->reflex_active);
+        spin_unlock_irqrestore(&gpio_dev->reflex_lock, flags);
+
+        gpio_set_interrupt(gpio_dev, rx->in_gpio, GPIO_INT_ENABLE);
+    }
+
+    mutex_unlock(&gpio_dev->reflex_mutex);
+    return 0;
+}
+
+static int gpio_get_reflex_stats(struct gpio_device *gpio_dev, struct gpio_reflex_stats *stats)
+{
+    struct gpio_reflex_rule *r;
+    unsigned long flags;
+
+    if (stats->index >= GPIO_REFLEX_MAX)
+        return -EINVAL;
+
+    r = &gpio_dev->reflex[stats->index];
+    spin_lock_irqsave(&gpio_dev->reflex_lock, flags);
+    stats->hits = r->hits;
+    stats->missed = r->missed;
+    stats->latency_min_ns = r->lat_min_ns;
+    stats->latency_max_ns = r->lat_max_ns;
+    stats->latency_total_ns = r->lat_total_ns;
+    spin_unlock_irqrestore(&gpio_dev->reflex_lock, flags);
+
+    return 0;
+}
+
+/* PWM lock held: drive the transition due at c->next_ns and schedule the next */
+static void __gpio_pwm_edge(struct gpio_device *gpio_dev, int gpio_num, 
+                            struct gpio_pwm_chan *c, u64 now)
+{
+    u64 late = now - c->next_ns;
+    u64 missed;
+
+    if (!gpio_irq_drive(gpio_dev, gpio_num, 
+                        c->high ? GPIO_REFLEX_CLEAR : GPIO_REFLEX_SET)) {
+        /* Turned into an input under us, the channel stops */
+        clear_bit(gpio_num, &gpio_dev->pwm_active);
+        return;
+    }
+
+    c->high = !c->high;
+    if (c->high) {
+        if (!c->rises)
+            c->first_rise_ns = now;
+        c->last_rise_ns = now;
+        c->rises++;
+        c->next_ns += c->duty_ns;
+    } else {
+        c->high_total_ns += now - c->last_rise_ns;
+        c->falls++;
+        c->next_ns += c->period_ns - c->duty_ns;
+    }
+
+    if (late > c->late_max_ns)
+        c->late_max_ns = late;
+    c->late_total_ns += late;
+
+    /* Too far behind: drop whole periods, the phase stays where it was */
+    if (c->next_ns <= now) {
+        missed = div64_u64(now - c->next_ns, c->period_ns) + 1;
+        c->next_ns += missed * c->period_ns;
+        c->skipped += missed;
+    }
+}
+
+/* One timer for the whole bank, it sleeps until the earliest transition */
+static enum hrtimer_restart gpio_pwm_timer(struct hrtimer *timer)
+{
+    struct gpio_device *gpio_dev = container_of(timer, struct gpio_device, pwm_timer);
+    enum hrtimer_restart ret = HRTIMER_NORESTART;
+    u64 now = ktime_get_ns();
+    u64 next = U64_MAX;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&gpio_dev->pwm_lock, flags);
+    for_each_set_bit(i, &gpio_dev->pwm_active, gpio_dev->ngpio) {
+        if (gpio_dev->pwm[i].next_ns <= now)
+            __gpio_pwm_edge(gpio_dev, i, &gpio_dev->pwm[i], now);
+        if (test_bit(i, &gpio_dev->pwm_active))
+            next = min(next, gpio_dev->pwm[i].next_ns);
+    }
+
+    /* If GPIO_SET_PWM re-armed us meanwhile, that expiry covers everything */
+    if (next != U64_MAX && !hrtimer_is_queued(timer)) {
+        hrtimer_set_expires(timer, ns_to_ktime(next));
+        ret = HRTIMER_RESTART;
+    }
+    spin_unlock_irqrestore(&gpio_dev->pwm_lock, flags);
+
+    return ret;
+}
+
+static int gpio_set_pwm(struct gpio_device *gpio_dev, const struct gpio_pwm *pwm)
+{
+    struct gpio_pwm_chan *c;
+    unsigned long flags;
+    int gpio_num = pwm->gpio_num;
+    bool high;
+    int ret = 0;
+
+    if (pwm->gpio_num >= (u32)gpio_dev->ngpio)
+        return -EINVAL;
+    if (pwm->period_ns && 
+        (pwm->period_ns < GPIO_PWM_MIN_PERIOD_NS || pwm->duty_ns > pwm->period_ns))
+        return -EINVAL;
+
+    c = &gpio_dev->pwm[gpio_num];
+    spin_lock_irqsave(&gpio_dev->pwm_lock, flags);
+    clear_bit(gpio_num, &gpio_dev->pwm_active);
+    memset(c, 0, sizeof(*c));
+    c->period_ns = pwm->period_ns;
+    c->duty_ns = pwm->duty_ns;
+
+    /* Constant levels need no edges; the first period starts right away */
+    high = pwm->period_ns && pwm->duty_ns == pwm->period_ns;
+    if (!gpio_irq_drive(gpio_dev, gpio_num, 
+                        high ? GPIO_REFLEX_SET : GPIO_REFLEX_CLEAR) && pwm->period_ns)
+        ret = -EPERM;
+    if (!ret && pwm->duty_ns && pwm->duty_ns < pwm->period_ns) {
+        c->next_ns = ktime_get_ns();
+        set_bit(gpio_num, &gpio_dev->pwm_active);
+        /* The callback recomputes its expiry from all channels */
+        hrtimer_start(&gpio_dev->pwm_timer, ns_to_ktime(c->next_ns), 
+                      HRTIMER_MODE_ABS_HARD);
+    }
+    spin_unlock_irqrestore(&gpio_dev->pwm_lock, flags);
+
+    if (ret)
+        gpio_pin_stat_inc(gpio_num, eperm);
+    return ret;
+}
+
+static int gpio_get_pwm_stats(struct gpio_device *gpio_dev, struct gpio_pwm_stats *stats)
+{
+    struct gpio_pwm_chan *c;
+    unsigned long flags;
+
+    if (stats->gpio_num >= (u32)gpio_dev->ngpio)
+        return -EINVAL;
+
+    c = &gpio_dev->pwm[stats->gpio_num];
+    spin_lock_irqsave(&gpio_dev->pwm_lock, flags);
+    stats->period_ns = c->period_ns;
+    stats->duty_ns = c->duty_ns;
+    stats->periods = c->rises;
+    stats->achieved_period_ns = c->rises > 1 ? 
+        div64_u64(c->last_rise_ns - c->first_rise_ns, c->rises - 1) : 0;
+    stats->achieved_duty_ns = c->falls ? div64_u64(c->high_total_ns, c->falls) : 0;
+    stats->late_max_ns = c->late_max_ns;
+    stats->late_total_ns = c->late_total_ns;
+    stats->skipped = c->skipped;
+    spin_unlock_irqrestore(&gpio_dev->pwm_lock, flags);
+
+    return 0;
+}
+
+/* Pin lock held: the status was just acknowledged and masked */
+static void __gpio_debounce_start(struct gpio_device *gpio_dev, struct gpio_pin *pin)
+{
+    /* Another edge inside the window, start the window over */
+    if (pin->debouncing)
+        atomic64_inc(&gpio_dev->bounces_filtered);
+
+    pin->debouncing = true;
+    hrtimer_start(&pin->debounce_timer, ns_to_ktime(pin->debounce_ns), 
+                  HRTIMER_MODE_REL_HARD);
+}
+
+/*
+ * End of a debounce window: re-sample the pin, unmask its interrupt and
+ * report the transition only if the level really changed.
+ */
+static enum hrtimer_restart gpio_debounce_timer(struct hrtimer *timer)
+{
+    struct gpio_pin *pin = container_of(timer, struct gpio_pin, debounce_timer);
+    struct gpio_device *gpio_dev = pin->gpio_dev;
+    int gpio_num = pin - gpio_dev->pins;
+    u64 now = ktime_get_ns();
+    unsigned long flags;
+    bool wanted = false;
+    u32 reg_val;
+    int level, prev;
+
+    spin_lock_irqsave(&pin->lock, flags);
+    if (!pin->debouncing) {
+        spin_unlock_irqrestore(&pin->lock, flags);
+        return HRTIMER_NORESTART;
+    }
+
+    reg_val = gpio_read_reg(gpio_dev, gpio_num);
+    level = (reg_val & GPIO_DATA_BIT) ? 1 : 0;
+
+    /* Anything latched while masked was a bounce; ack it and unmask */
+    if (reg_val & GPIO_INT_STATUS_BIT)
+        atomic64_inc(&gpio_dev->bounces_filtered);
+    pin->debouncing = false;
+    gpio_write_reg(gpio_dev, gpio_num, pin->shadow | GPIO_INT_STATUS_BIT);
+
+    prev = pin->last_level;
+    if (level != prev) {
+        wanted = __gpio_edge_wanted(pin, level);
+        if (test_bit(gpio_num, &gpio_dev->counting)) {
+            __gpio_count_edge(pin, prev, level, now);
+            wanted = false;
+        }
+    } else {
+        atomic64_inc(&gpio_dev->bounces_filtered);  /* settled where it began */
+    }
+    spin_unlock_irqrestore(&pin->lock, flags);
+
+    /* A settled edge is the one the reflexes of a debounced pin act on */
+    if (level != prev && READ_ONCE(gpio_dev->reflex_active))
+        gpio_reflex_run(gpio_dev, gpio_num, prev, level, now);
+
+    if (wanted)
+        gpio_dispatch_event(gpio_dev, gpio_num, level, now);
+
+    return HRTIMER_NORESTART;
+}
+
+/*
+ * Hard-IRQ half: latch and acknowledge the status bits, nothing else.
+ * Only pins with interrupts enabled are visited, each register is read
+ * once and the W1TC acknowledge writes that same value back.
+ */
+static irqreturn_t __gpio_irq_handler(int irq, void *dev_id)
+{
+    struct gpio_device *gpio_dev = dev_id;
+    struct gpio_irq_latch latch = { .timestamp_ns = ktime_get_ns() };
+    struct gpio_irq_stats *stats = &gpio_dev->irq_stats;
+    unsigned long enabled = READ_ONCE(gpio_dev->irq_enabled);
+    unsigned long demux = 0;
+    struct gpio_pin *pin;
+    bool wanted = false;
+    bool debounced = false;
+    bool claimed, counting;
+    int handled = 0;
+    int prev = 0;
+    int i;
+    u32 reg_val;
+
+    stats->irqs++;
+
+    for_each_set_bit(i, &enabled, gpio_dev->ngpio) {
+        pin = &gpio_dev->pins[i];
+        claimed = gpio_irq_claimed(gpio_dev, i);
+        counting = test_bit(i, &gpio_dev->counting);
+
+        /* Keeps a concurrent config write from slipping in between */
+        spin_lock(&pin->lock);
+        reg_val = gpio_read_reg(gpio_dev, i);
+        if (reg_val & GPIO_INT_STATUS_BIT) {
+            debounced = !claimed && pin->debounce_ns != 0;
+            if (debounced) {
+                /* Ack and mask in one write, the timer decides what settled */
+                gpio_write_reg(gpio_dev, i, reg_val & ~GPIO_INT_ENABLE_BIT);
+                __gpio_debounce_start(gpio_dev, pin);
+            } else {
+                prev = pin->last_level;
+                wanted = __gpio_edge_wanted(pin, (reg_val & GPIO_DATA_BIT) ? 1 : 0);
+                if (counting)
+                    __gpio_count_edge(pin, prev, pin->last_level, latch.timestamp_ns);
+                /* Wanted edges of a claimed pin are acked by its flow handler */
+                if (!claimed || !wanted)
+                    gpio_write_reg(gpio_dev, i, reg_val);
+            }
+            if (debounced || !claimed || !wanted) {
+                stats->mmio_writes++;
+                gpio_pin_stat_inc(i, irqs_cleared);
+                trace_gpio_int_clear(i, reg_val, true);
+            }
+            gpio_pin_stat_inc(i, irqs);
+        }
+        spin_unlock(&pin->lock);
+
+        stats->pins_scanned++;
+        stats->mmio_reads++;
+
+        if (!(reg_val & GPIO_INT_STATUS_BIT))
+            continue;
+
+        handled = 1;
+        stats->pins_pending++;
+        if (debounced)
+            continue;
+
+        /* Reflexes see every edge, before the event filter */
+        if (READ_ONCE(gpio_dev->reflex_active) && !claimed)
+            gpio_reflex_run(gpio_dev, i, prev, (reg_val & GPIO_DATA_BIT) ? 1 : 0, 
+                            latch.timestamp_ns);
+
+        /* Counted above, never queued */
+        if (counting)
+            continue;
+
+        if (!wanted) {
+            stats->edges_filtered++;
+            continue;
+        }
+        if (claimed) {
+            demux |= BIT(i);
+            continue;
+        }
+
+        latch.pending |= BIT(i);
+        if (reg_val & GPIO_DATA_BIT)
+            latch.levels |= BIT(i);
+    }
+
+    if (!handled) {
+        stats->unhandled++;
+        return IRQ_NONE;
+    }
+
+    /* Claimed pins run their consumer's handler right here, in hard IRQ */
+    for_each_set_bit(i, &demux, gpio_dev->ngpio)
+        generic_handle_domain_irq(gpio_dev->chip.irq.domain, i);
+
+    /* Everything was filtered out, no reason to wake the thread */
+    if (!latch.pending)
+        return IRQ_HANDLED;
+
+    if (!kfifo_put(&gpio_dev->irq_latches, latch)) {
+        atomic_add(hweight32(latch.pending), &gpio_dev->latch_overruns);
+        return IRQ_HANDLED;
+    }
+
+    return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t gpio_irq_handler(int irq, void *dev_id)
+{
+    struct gpio_device *gpio_dev = dev_id;
+    u64 start = local_clock();
+    irqreturn_t ret;
+
+    trace_gpio_irq_entry(irq, READ_ONCE(gpio_dev->irq_enabled));
+    ret = __gpio_irq_handler(irq, dev_id);
+    gpio_hist_add(irq, local_clock() - start);
+    return ret;
+}
+
+static int gpio_get_irq_stats(struct gpio_device *gpio_dev, struct gpio_irq_stats *stats)
+{
+    /* Torn reads are possible but harmless for monotonic counters */
+    *stats = gpio_dev->irq_stats;
+    stats->bounces_filtered = atomic64_read(&gpio_dev->bounces_filtered);
+    return 0;
+}
+
+static int gpio_set_counter(struct gpio_device *gpio_dev, int gpio_num, int enable)
+{
+    struct gpio_pin *pin;
+    unsigned long flags;
+
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+    if (gpio_irq_claimed(gpio_dev, gpio_num))
+        return -EBUSY;
+
+    if (!enable) {
+        clear_bit(gpio_num, &gpio_dev->counting);
+        return 0;
+    }
+
+    pin = &gpio_dev->pins[gpio_num];
+    spin_lock_irqsave(&pin->lock, flags);
+    memset(&pin->counter, 0, sizeof(pin->counter));
+    /* The first interrupt must not look like a lost pulse */
+    pin->last_level = __gpio_read_pin(gpio_dev, gpio_num);
+    set_bit(gpio_num, &gpio_dev->counting);
+    spin_unlock_irqrestore(&pin->lock, flags);
+
+    return gpio_set_interrupt(gpio_dev, gpio_num, GPIO_INT_ENABLE);
+}
+
+static void gpio_interval_report(const struct gpio_interval *iv, u64 *count, 
+                                 u64 *min_ns, u64 *max_ns, u64 *avg_ns)
+{
+    *count = iv->count;
+    *min_ns = iv->min_ns;
+    *max_ns = iv->max_ns;
+    *avg_ns = iv->count ? div64_u64(iv->total_ns, iv->count) : 0;
+}
+
+/* Too big for the ioctl stack frame; each pin is a consistent snapshot */
+static int gpio_get_counters(struct gpio_device *gpio_dev, struct gpio_counters __user *ucnt)
+{
+    struct gpio_counters *cnt;
+    struct gpio_pin_counter c;
+    unsigned long flags;
+    int ret = 0;
+    int i;
+
+    cnt = kzalloc(sizeof(*cnt), GFP_KERNEL);
+    if (!cnt)
+        return -ENOMEM;
+
+    cnt->mask = READ_ONCE(gpio_dev->counting);
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        struct gpio_counter *out = &cnt->pins[i];
+
+        spin_lock_irqsave(&gpio_dev->pins[i].lock, flags);
+        c = gpio_dev->pins[i].counter;
+        spin_unlock_irqrestore(&gpio_dev->pins[i].lock, flags);
+
+        out->rising = c.rising;
+        out->falling = c.falling;
+        out->missed = c.missed;
+        out->last_edge_ns = c.last_edge_ns;
+        gpio_interval_report(&c.width, &out->widths, &out->width_min_ns, 
+                             &out->width_max_ns, &out->width_avg_ns);
+        gpio_interval_report(&c.period, &out->periods, &out->period_min_ns, 
+                             &out->period_max_ns, &out->period_avg_ns);
+    }
+
+    if (copy_to_user(ucnt, cnt, sizeof(*cnt)))
+        ret = -EFAULT;
+
+    kfree(cnt);
+    return ret;
+}
+
+static void gpio_stats_sum(struct gpio_device *gpio_dev, struct gpio_stats *sum)
+{
+    const u64 *src;
+    u64 *dst = (u64 *)sum;
+    size_t i;
+    int cpu;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        src = (const u64 *)per_cpu_ptr(gpio_dev->stats, cpu);
+        for (i = 0; i < sizeof(*sum) / sizeof(u64); i++)
+            dst[i] += src[i];
+    }
+}
+
+/* Too big for the ioctl stack frame */
+static int gpio_get_stats(struct gpio_device *gpio_dev, struct gpio_stats __user *ustats)
+{
+    struct gpio_stats *stats;
+    int ret = 0;
+
+    stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+    if (!stats)
+        return -ENOMEM;
+
+    gpio_stats_sum(gpio_dev, stats);
+    if (copy_to_user(ustats, stats, sizeof(*stats)))
+        ret = -EFAULT;
+
+    kfree(stats);
+    return ret;
+}
+
+static void gpio_stats_cmd(struct gpio_device *gpio_dev, unsigned int cmd, long ret)
+{
+    struct gpio_cmd_stats __percpu *cs;
+
+    if (_IOC_TYPE(cmd) != GPIO_IOC_MAGIC || _IOC_NR(cmd) >= GPIO_STATS_NR_CMDS)
+        return;
+
+    cs = &gpio_dev->stats->cmds[_IOC_NR(cmd)];
+    this_cpu_inc(cs->calls);
+    if (ret == -EPERM)
+        this_cpu_inc(cs->eperm);
+    else if (ret == -EINVAL)
+        this_cpu_inc(cs->einval);
+}
+
+/* Runs once in the IRQ thread's own context */
+static void gpio_irq_thread_setup(struct gpio_device *gpio_dev)
+{
+    struct sched_attr attr = {
+        .size = sizeof(attr),
+        .sched_policy = SCHED_FIFO,
+        .sched_priority = irq_thread_prio,
+    };
+    int ret;
+
+    gpio_dev->irq_thread_ready = true;
+
+    if (!irq_thread_prio)
+        return;
+
+    ret = sched_setattr_nocheck(current, &attr);
+    if (ret)
+        pr_warn("GPIO Driver: Failed to set IRQ thread priority %d (error %d)\n", 
+                irq_thread_prio, ret);
+}
+
+/* Threaded half: turn latched status bits into events */
+static irqreturn_t gpio_irq_thread(int irq, void *dev_id)
+{
+    struct gpio_device *gpio_dev = dev_id;
+    u64 start = ktime_get_ns();
+    struct gpio_irq_latch latch;
+    unsigned long pending;
+    int i;
+
+    if (unlikely(!gpio_dev->irq_thread_ready))
+        gpio_irq_thread_setup(gpio_dev);
+
+    while (kfifo_get(&gpio_dev->irq_latches, &latch)) {
+        pending = latch.pending;
+        for_each_set_bit(i, &pending, gpio_dev->ngpio)
+            gpio_dispatch_event(gpio_dev, i, (latch.levels & BIT(i)) ? 1 : 0, 
+                                latch.timestamp_ns);
+    }
+
+    gpio_hist_add(irq_thread, ktime_get_ns() - start);
+    return IRQ_HANDLED;
+}
+
+static int gpio_open(struct inode *inode, struct file *filp)
+{
+    filp->private_data = container_of(inode->i_cdev, struct gpio_device, cdev);
+    pr_debug("GPIO device opened\n");
+    return 0;
+}
+
+static int gpio_release(struct inode *inode, struct file *filp)
+{
+    pr_debug("GPIO device closed\n");
+    return 0;
+}
+
+/* Copy up to max records out of the ring; read_lock is held */
+static ssize_t gpio_event_copy_out(struct gpio_device *gpio_dev, char __user *buf, u32 max)
+{
+    struct gpio_event_ring *ring = gpio_dev->ring;
+    u32 head, tail, n, idx, chunk;
+
+    head = smp_load_acquire(&ring->head);
+    tail = READ_ONCE(ring->tail);
+    if (head - tail > GPIO_EVENT_RING_SIZE)
+        tail = head;    /* tail was scribbled on through mmap, resync */
+    n = min(head - tail, max);
+
+    idx = tail & (GPIO_EVENT_RING_SIZE - 1);
+    chunk = min(n, GPIO_EVENT_RING_SIZE - idx);
+    if (copy_to_user(buf, &gpio_dev->ring_data[idx], 
+                     chunk * sizeof(struct gpio_event)))
+        return -EFAULT;
+    if (n > chunk && copy_to_user(buf + chunk * sizeof(struct gpio_event), 
+                                  gpio_dev->ring_data, 
+                                  (n - chunk) * sizeof(struct gpio_event)))
+        return -EFAULT;
+
+    /* Done with the slots, hand them back to the producer */
+    smp_store_release(&ring->tail, tail + n);
+
+    return n * sizeof(struct gpio_event);
+}
+
+/* Samples applied per timer expiry, so zero-delay runs cannot hog the CPU */
+#define GPIO_OUT_BATCH 64
+
+static u32 gpio_out_space(struct gpio_device *gpio_dev)
+{
+    return GPIO_OUT_QUEUE_SIZE - (READ_ONCE(gpio_dev->out_head) - 
+                                  READ_ONCE(gpio_dev->out_tail));
+}
+
+/* Out lock held: play from out_pos, its delay counted from now */
+static void __gpio_out_start(struct gpio_device *gpio_dev)
+{
+    struct gpio_out_sample *smp;
+
+    smp = &gpio_dev->out_buf[gpio_dev->out_pos & (GPIO_OUT_QUEUE_SIZE - 1)];
+    gpio_dev->out_next_ns = ktime_get_ns() + smp->delta_ns;
+    gpio_dev->out_running = true;
+    hrtimer_start(&gpio_dev->out_timer, ns_to_ktime(gpio_dev->out_next_ns), 
+                  HRTIMER_MODE_ABS_HARD);
+}
+
+static enum hrtimer_restart gpio_out_timer(struct hrtimer *timer)
+{
+    struct gpio_device *gpio_dev = container_of(timer, struct gpio_device, out_timer);
+    enum hrtimer_restart ret = HRTIMER_NORESTART;
+    struct gpio_out_sample *smp;
+    u64 now = ktime_get_ns();
+    int budget = GPIO_OUT_BATCH;
+    unsigned long flags;
+    bool freed = false;
+
+    spin_lock_irqsave(&gpio_dev->out_lock, flags);
+    while (gpio_dev->out_running) {
+        /* Next sample not due yet, or yield after a long zero-delay run */
+        if (gpio_dev->out_next_ns > now || !budget--) {
+            hrtimer_set_expires(timer, ns_to_ktime(gpio_dev->out_next_ns));
+            ret = HRTIMER_RESTART;
+            break;
+        }
+
+        smp = &gpio_dev->out_buf[gpio_dev->out_pos & (GPIO_OUT_QUEUE_SIZE - 1)];
+        if (gpio_write_mask(gpio_dev, smp->mask, smp->value))
+            gpio_dev->out_rejected++;
+        gpio_dev->out_late_max_ns = max(gpio_dev->out_late_max_ns, 
+                                        now - gpio_dev->out_next_ns);
+        gpio_dev->out_played++;
+
+        gpio_dev->out_pos++;
+        if (!(gpio_dev->out_flags & GPIO_OUT_LOOP)) {
+            WRITE_ONCE(gpio_dev->out_tail, gpio_dev->out_pos);
+            freed = true;
+        }
+
+        if (gpio_dev->out_pos == gpio_dev->out_head) {
+            if ((gpio_dev->out_flags & GPIO_OUT_LOOP) && 
+                gpio_dev->out_head != gpio_dev->out_tail) {
+                gpio_dev->out_pos = gpio_dev->out_tail;
+            } else {
+                gpio_dev->out_running = false;
+                gpio_dev->out_underruns++;
+                break;
+            }
+        }
+
+        smp = &gpio_dev->out_buf[gpio_dev->out_pos & (GPIO_OUT_QUEUE_SIZE - 1)];
+        gpio_dev->out_next_ns += smp->delta_ns;
+    }
+    spin_unlock_irqrestore(&gpio_dev->out_lock, flags);
+
+    if (freed)
+        wake_up_interruptible(&gpio_dev->out_wait);
+    return ret;
+}
+
+static ssize_t gpio_write(struct file *filp, const char __user *buf, size_t count, 
+                          loff_t *ppos)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    size_t n = count / sizeof(struct gpio_out_sample);
+    size_t done = 0;
+    unsigned long flags;
+    u32 space, chunk, idx, i;
+    int ret = 0;
+
+    if (n == 0)
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&gpio_dev->write_lock))
+        return -ERESTARTSYS;
+
+    while (done < n) {
+        space = gpio_out_space(gpio_dev);
+        if (!space) {
+            if (done)
+                break;
+            if (filp->f_flags & O_NONBLOCK) {
+                ret = -EAGAIN;
+                break;
+            }
+            ret = wait_event_interruptible(gpio_dev->out_wait, 
+                                           gpio_out_space(gpio_dev));
+            if (ret)
+                break;
+            continue;
+        }
+
+        /* Up to the end of the buffer, the rest goes in the next round */
+        idx = gpio_dev->out_head & (GPIO_OUT_QUEUE_SIZE - 1);
+        chunk = min3((size_t)space, n - done, (size_t)(GPIO_OUT_QUEUE_SIZE - idx));
+        if (copy_from_user(&gpio_dev->out_buf[idx], 
+                           buf + done * sizeof(struct gpio_out_sample), 
+                           chunk * sizeof(struct gpio_out_sample))) {
+            ret = -EFAULT;
+            break;
+        }
+        for (i = 0; i < chunk; i++) {
+            if (gpio_dev->out_buf[idx + i].mask & ~gpio_all_pins(gpio_dev))
+                break;
+        }
+        if (i < chunk) {
+            ret = -EINVAL;
+            chunk = i;  /* publish the valid ones in front of it */
+        }
+
+        spin_lock_irqsave(&gpio_dev->out_lock, flags);
+        WRITE_ONCE(gpio_dev->out_head, gpio_dev->out_head + chunk);
+        if (!gpio_dev->out_running && gpio_dev->out_pos != gpio_dev->out_head)
+            __gpio_out_start(gpio_dev);
+        spin_unlock_irqrestore(&gpio_dev->out_lock, flags);
+
+        done += chunk;
+        if (ret)
+            break;
+    }
+
+    mutex_unlock(&gpio_dev->write_lock);
+    return done ? (ssize_t)(done * sizeof(struct gpio_out_sample)) : (ssize_t)ret;
+}
+
+static int gpio_set_out_mode(struct gpio_device *gpio_dev, u32 mode)
+{
+    unsigned long flags;
+
+    if (mode & ~(GPIO_OUT_LOOP | GPIO_OUT_FLUSH))
+        return -EINVAL;
+
+    /* Keeps a writer from publishing into a queue we are emptying */
+    mutex_lock(&gpio_dev->write_lock);
+    spin_lock_irqsave(&gpio_dev->out_lock, flags);
+    if (mode & GPIO_OUT_FLUSH) {
+        gpio_dev->out_running = false;
+        gpio_dev->out_tail = gpio_dev->out_head;
+        gpio_dev->out_pos = gpio_dev->out_head;
+    } else if ((gpio_dev->out_flags & GPIO_OUT_LOOP) && !(mode & GPIO_OUT_LOOP)) {
+        /* Leaving loop mode: finish the current round, then stop */
+        gpio_dev->out_tail = gpio_dev->out_pos;
+    }
+    gpio_dev->out_flags = mode & GPIO_OUT_LOOP;
+    spin_unlock_irqrestore(&gpio_dev->out_lock, flags);
+
+    /*
+     * Still under write_lock, so a writer cannot restart the queue and
+     * have its fresh timer cancelled here; the timer never takes the mutex.
+     */
+    if (mode & GPIO_OUT_FLUSH)
+        hrtimer_cancel(&gpio_dev->out_timer);
+    mutex_unlock(&gpio_dev->write_lock);
+
+    wake_up_interruptible(&gpio_dev->out_wait);
+    return 0;
+}
+
+static int gpio_get_out_stats(struct gpio_device *gpio_dev, struct gpio_out_stats *stats)
+{
+    unsigned long flags;
+
+    spin_lock_irqsave(&gpio_dev->out_lock, flags);
+    stats->played = gpio_dev->out_played;
+    stats->underruns = gpio_dev->out_underruns;
+    stats->rejected = gpio_dev->out_rejected;
+    stats->late_max_ns = gpio_dev->out_late_max_ns;
+    stats->queued = gpio_dev->out_head - gpio_dev->out_tail;
+    stats->capacity = GPIO_OUT_QUEUE_SIZE;
+    stats->flags = gpio_dev->out_flags;
+    stats->running = gpio_dev->out_running;
+    spin_unlock_irqrestore(&gpio_dev->out_lock, flags);
+
+    return 0;
+}
+
+/* Data bit of every pin from one pass, no config write can slip in between */
+static u32 gpio_capture_snapshot(struct gpio_device *gpio_dev)
+{
+    unsigned long flags;
+    u32 value = 0;
+    int i;
+
+    gpio_lock_pins(gpio_dev, gpio_all_pins(gpio_dev), &flags);
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        if (gpio_read_reg(gpio_dev, i) & GPIO_DATA_BIT)
+            value |= BIT(i);
+    }
+    gpio_unlock_pins(gpio_dev, gpio_all_pins(gpio_dev), flags);
+
+    return value;
+}
+
+/* Capture lock held: append n samples of value, false if the buffer is full */
+static bool __gpio_capture_add(struct gpio_capture *cap, u32 value, u64 n)
+{
+    struct gpio_capture_run *run;
+    u64 limit, excess;
+
+    run = cap->nr ? &cap->runs[(cap->first + cap->nr - 1) % GPIO_CAPTURE_RUNS] : NULL;
+    if (run && run->value == value && run->count <= U32_MAX - n) {
+        run->count += n;
+    } else {
+        if (cap->nr == GPIO_CAPTURE_RUNS) {
+            if (cap->state != GPIO_CAPTURE_ARMED)
+                return false;
+            /* Still waiting for the trigger: the oldest run makes room */
+            cap->samples -= cap->runs[cap->first].count;
+            cap->first = (cap->first + 1) % GPIO_CAPTURE_RUNS;
+            cap->nr--;
+        }
+        run = &cap->runs[(cap->first + cap->nr) % GPIO_CAPTURE_RUNS];
+        run->value = value;
+        run->count = n;
+        cap->nr++;
+    }
+    cap->samples += n;
+
+    /* Before the trigger only the pre-trigger window and this sample stay */
+    if (cap->state != GPIO_CAPTURE_ARMED)
+        return true;
+
+    limit = (u64)cap->cfg.pre_samples + 1;
+    while (cap->samples > limit) {
+        excess = cap->samples - limit;
+        run = &cap->runs[cap->first];
+        if (run->count > excess) {
+            run->count -= excess;
+            cap->samples -= excess;
+        } else {
+            cap->samples -= run->count;
+            cap->first = (cap->first + 1) % GPIO_CAPTURE_RUNS;
+            cap->nr--;
+        }
+    }
+    return true;
+}
+
+static enum hrtimer_restart gpio_capture_timer(struct hrtimer *timer)
+{
+    struct gpio_device *gpio_dev = container_of(timer, struct gpio_device, capture.timer);
+    struct gpio_capture *cap = &gpio_dev->capture;
+    enum hrtimer_restart ret = HRTIMER_RESTART;
+    unsigned long flags;
+    u64 n, now;
+    u32 value;
+
+    /* A late expiry stands for every period it missed */
+    n = hrtimer_forward_now(timer, ns_to_ktime(cap->cfg.period_ns));
+    if (!n)
+        n = 1;
+    value = gpio_capture_snapshot(gpio_dev);
+    now = ktime_get_ns();
+
+    spin_lock_irqsave(&cap->lock, flags);
+    if (cap->state != GPIO_CAPTURE_ARMED && cap->state != GPIO_CAPTURE_TRIGGERED) {
+        spin_unlock_irqrestore(&cap->lock, flags);
+        return HRTIMER_NORESTART;
+    }
+
+    cap->late_ticks += n - 1;
+    cap->last_ns = now;
+    if (!__gpio_capture_add(cap, value, n)) {
+        cap->truncated = true;
+        cap->state = GPIO_CAPTURE_DONE;
+        ret = HRTIMER_NORESTART;
+    } else if (cap->state == GPIO_CAPTURE_TRIGGERED) {
+        cap->post_left -= min(cap->post_left, n);
+    } else if ((value & cap->cfg.trig_mask) == cap->cfg.trig_value) {
+        cap->state = GPIO_CAPTURE_TRIGGERED;
+        cap->trigger_sample = cap->samples - 1;
+        cap->post_left = cap->cfg.post_samples;
+    }
+
+    if (cap->state == GPIO_CAPTURE_TRIGGERED && !cap->post_left) {
+        cap->state = GPIO_CAPTURE_DONE;
+        ret = HRTIMER_NORESTART;
+    }
+    spin_unlock_irqrestore(&cap->lock, flags);
+
+    return ret;
+}
+
+static int gpio_capture_start(struct gpio_device *gpio_dev, 
+                              const struct gpio_capture_config *cfg)
+{
+    struct gpio_capture *cap = &gpio_dev->capture;
+    unsigned long flags;
+
+    if (cfg->period_ns < GPIO_CAPTURE_MIN_PERIOD_NS)
+        return -EINVAL;
+    if ((cfg->trig_mask & ~gpio_all_pins(gpio_dev)) || (cfg->trig_value & ~cfg->trig_mask))
+        return -EINVAL;
+
+    mutex_lock(&cap->mutex);
+    hrtimer_cancel(&cap->timer);
+
+    if (!cap->runs) {
+        cap->runs = vmalloc_user(GPIO_CAPTURE_RUNS * sizeof(struct gpio_capture_run));
+        if (!cap->runs) {
+            mutex_unlock(&cap->mutex);
+            return -ENOMEM;
+        }
+    }
+
+    spin_lock_irqsave(&cap->lock, flags);
+    cap->cfg = *cfg;
+    cap->state = GPIO_CAPTURE_ARMED;
+    cap->first = 0;
+    cap->nr = 0;
+    cap->samples = 0;
+    cap->trigger_sample = 0;
+    cap->post_left = 0;
+    cap->late_ticks = 0;
+    cap->truncated = false;
+    spin_unlock_irqrestore(&cap->lock, flags);
+
+    hrtimer_start(&cap->timer, ns_to_ktime(cfg->period_ns), HRTIMER_MODE_REL_HARD);
+    mutex_unlock(&cap->mutex);
+    return 0;
+}
+
+static int gpio_capture_stop(struct gpio_device *gpio_dev)
+{
+    struct gpio_capture *cap = &gpio_dev->capture;
+    unsigned long flags;
+
+    mutex_lock(&cap->mutex);
+    spin_lock_irqsave(&cap->lock, flags);
+    if (cap->state != GPIO_CAPTURE_IDLE)
+        cap->state = GPIO_CAPTURE_DONE;
+    spin_unlock_irqrestore(&cap->lock, flags);
+    hrtimer_cancel(&cap->timer);
+    mutex_unlock(&cap->mutex);
+
+    return 0;
+}
+
+static int gpio_capture_status(struct gpio_device *gpio_dev, 
+                               struct gpio_capture_status *status)
+{
+    struct gpio_capture *cap = &gpio_dev->capture;
+    unsigned long flags;
+
+    memset(status, 0, sizeof(*status));
+
+    spin_lock_irqsave(&cap->lock, flags);
+    status->state = cap->state;
+    status->capacity = GPIO_CAPTURE_RUNS;
+    status->first_run = cap->first;
+    status->nr_runs = cap->nr;
+    status->samples = cap->samples;
+    status->trigger_sample = cap->trigger_sample;
+    if (cap->samples)
+        status->start_ns = cap->last_ns - (cap->samples - 1) * cap->cfg.period_ns;
+    status->late_ticks = cap->late_ticks;
+    status->truncated = cap->truncated;
+    spin_unlock_irqrestore(&cap->lock, flags);
+
+    return 0;
+}
+
+/*
+ * Sequencer lock and the pin locks held: run one tick of the program.
+ * Returns with the machine still running unless it ended or faulted.
+ */
+static void __gpio_seq_tick(struct gpio_device *gpio_dev, struct gpio_seq *sq)
+{
+    struct gpio_seq_insn *in;
+    u32 budget = sq->steps_per_tick;
+    bool taken;
+    u32 cfg;
+
+    if (sq->delay && --sq->delay) {
+        sq->stall_ticks++;
+        return;
+    }
+
+    while (budget--) {
+        if (sq->pc >= sq->ninsns) {
+            sq->state = GPIO_SEQ_DONE;
+            return;
+        }
+        in = &sq->insns[sq->pc];
+        sq->steps++;
+
+        switch (in->op) {
+        case GPIO_SEQ_END:
+            sq->state = GPIO_SEQ_DONE;
+            return;
+        case GPIO_SEQ_SET:
+        case GPIO_SEQ_TOGGLE:
+            cfg = gpio_cfg_read(gpio_dev, in->pin);
+            if (!(cfg & GPIO_DIR_BIT)) {
+                gpio_pin_stat_inc(in->pin, eperm);
+                sq->state = GPIO_SEQ_FAULT;
+                return;
+            }
+            if (in->op == GPIO_SEQ_TOGGLE)
+                cfg ^= GPIO_DATA_BIT;
+            else if (in->arg)
+                cfg |= GPIO_DATA_BIT;
+            else
+                cfg &= ~GPIO_DATA_BIT;
+            gpio_cfg_write(gpio_dev, in->pin, cfg);
+            gpio_pin_stat_inc(in->pin, writes);
+            break;
+        case GPIO_SEQ_WAIT:
+            if (__gpio_read_pin(gpio_dev, in->pin) != !!in->arg) {
+                sq->stall_ticks++;
+                return;
+            }
+            break;
+        case GPIO_SEQ_DELAY:
+            sq->delay = in->arg;
+            sq->pc++;
+            return;
+        case GPIO_SEQ_IN:
+            sq->isr = (sq->isr << 1) | __gpio_read_pin(gpio_dev, in->pin);
+            break;
+        case GPIO_SEQ_PUSH:
+            if (kfifo_is_full(&sq->fifo) && in->arg != GPIO_SEQ_PUSH_DROP) {
+                sq->stall_ticks++;
+                return;
+            }
+            if (!kfifo_put(&sq->fifo, sq->isr))
+                sq->fifo_overflows++;
+            sq->isr = 0;
+            break;
+        case GPIO_SEQ_LOAD:
+            sq->x = in->arg;
+            break;
+        case GPIO_SEQ_JMP:
+            switch (in->cond) {
+            case GPIO_SEQ_X_DEC:
+                taken = sq->x != 0;
+                if (taken)
+                    sq->x--;
+                break;
+            case GPIO_SEQ_PIN_HIGH:
+                taken = __gpio_read_pin(gpio_dev, in->pin);
+                break;
+            case GPIO_SEQ_PIN_LOW:
+                taken = !__gpio_read_pin(gpio_dev, in->pin);
+                break;
+            default:
+                taken = true;
+                break;
+            }
+            if (taken) {
+                sq->pc = in->arg;
+                continue;
+            }
+            break;
+        }
+        sq->pc++;
+    }
+
+    sq->budget_ticks++;
+}
+
+static enum hrtimer_restart gpio_seq_timer(struct hrtimer *timer)
+{
+    struct gpio_seq *sq = container_of(timer, struct gpio_seq, timer);
+    struct gpio_device *gpio_dev = sq->gpio_dev;
+    enum hrtimer_restart ret;
+    unsigned long flags, pin_flags;
+    u64 n;
+
+    /* Missed periods are counted, not replayed */
+    n = hrtimer_forward_now(timer, ns_to_ktime(sq->period_ns));
+
+    spin_lock_irqsave(&sq->lock, flags);
+    if (sq->state != GPIO_SEQ_RUNNING) {
+        spin_unlock_irqrestore(&sq->lock, flags);
+        return HRTIMER_NORESTART;
+    }
+
+    if (n > 1)
+        sq->late_ticks += n - 1;
+    sq->ticks++;
+    gpio_lock_pins(gpio_dev, sq->pins, &pin_flags);
+    __gpio_seq_tick(gpio_dev, sq);
+    gpio_unlock_pins(gpio_dev, sq->pins, pin_flags);
+    ret = sq->state == GPIO_SEQ_RUNNING ? HRTIMER_RESTART : HRTIMER_NORESTART;
+    spin_unlock_irqrestore(&sq->lock, flags);
+
+    return ret;
+}
+
+/* Check a program before it is run, and collect the pins it uses */
+static int gpio_seq_verify(struct gpio_device *gpio_dev, const struct gpio_seq_insn *insns, 
+                           u32 ninsns, u32 *pins)
+{
+    const struct gpio_seq_insn *in;
+    bool uses_pin;
+    u32 i;
+
+    *pins = 0;
+    for (i = 0; i < ninsns; i++) {
+        in = &insns[i];
+        if (in->reserved || (in->cond && in->op != GPIO_SEQ_JMP))
+            return -EINVAL;
+
+        switch (in->op) {
+        case GPIO_SEQ_SET:
+        case GPIO_SEQ_WAIT:
+            uses_pin = true;
+            if (in->arg > 1)
+                return -EINVAL;
+            break;
+        case GPIO_SEQ_TOGGLE:
+        case GPIO_SEQ_IN:
+            uses_pin = true;
+            if (in->arg)
+                return -EINVAL;
+            break;
+        case GPIO_SEQ_DELAY:
+            uses_pin = false;
+            if (!in->arg)
+                return -EINVAL;
+            break;
+        case GPIO_SEQ_PUSH:
+            uses_pin = false;
+            if (in->arg > GPIO_SEQ_PUSH_DROP)
+                return -EINVAL;
+            break;
+        case GPIO_SEQ_END:
+        case GPIO_SEQ_LOAD:
+            uses_pin = false;
+            break;
+        case GPIO_SEQ_JMP:
+            if (in->cond > GPIO_SEQ_PIN_LOW || in->arg >= ninsns)
+                return -EINVAL;
+            uses_pin = in->cond == GPIO_SEQ_PIN_HIGH || in->cond == GPIO_SEQ_PIN_LOW;
+            break;
+        default:
+            return -EINVAL;
+        }
+
+        if (!uses_pin) {
+            if (in->pin)
+                return -EINVAL;
+            continue;
+        }
+        if (in->pin >= gpio_dev->ngpio)
+            return -EINVAL;
+        /* Outputs driven by the PWM timer are not ours to touch */
+        if ((in->op == GPIO_SEQ_SET || in->op == GPIO_SEQ_TOGGLE) && 
+            test_bit(in->pin, &gpio_dev->pwm_active))
+            return -EBUSY;
+        *pins |= BIT(in->pin);
+    }
+
+    return 0;
+}
+
+static int gpio_seq_load(struct gpio_device *gpio_dev, const struct gpio_seq_program *prog)
+{
+    struct gpio_seq_insn *insns;
+    struct gpio_seq *sq;
+    unsigned long flags;
+    u32 pins;
+    int ret;
+
+    if (prog->index >= GPIO_SEQ_MAX || prog->reserved)
+        return -EINVAL;
+    sq = &gpio_dev->seq[prog->index];
+
+    if (!prog->ninsns) {
+        mutex_lock(&gpio_dev->seq_mutex);
+        spin_lock_irqsave(&sq->lock, flags);
+        if (sq->state == GPIO_SEQ_RUNNING)
+            sq->state = GPIO_SEQ_IDLE;
+        spin_unlock_irqrestore(&sq->lock, flags);
+        hrtimer_cancel(&sq->timer);
+        mutex_unlock(&gpio_dev->seq_mutex);
+        return 0;
+    }
+
+    if (prog->ninsns > GPIO_SEQ_MAX_INSNS)
+        return -E2BIG;
+    if (!prog->steps_per_tick || prog->steps_per_tick > GPIO_SEQ_MAX_STEPS)
+        return -EINVAL;
+    if (prog->period_ns < GPIO_SEQ_MIN_PERIOD_NS)
+        return -EINVAL;
+
+    insns = memdup_user(u64_to_user_ptr(prog->insns), prog->ninsns * sizeof(*insns));
+    if (IS_ERR(insns))
+        return PTR_ERR(insns);
+
+    ret = gpio_seq_verify(gpio_dev, insns, prog->ninsns, &pins);
+    if (ret) {
+        kfree(insns);
+        return ret;
+    }
+
+    mutex_lock(&gpio_dev->seq_mutex);
+
+    /* Stop the old program; its FIFO contents go with it */
+    spin_lock_irqsave(&sq->lock, flags);
+    sq->state = GPIO_SEQ_IDLE;
+    spin_unlock_irqrestore(&sq->lock, flags);
+    hrtimer_cancel(&sq->timer);
+
+    spin_lock_irqsave(&sq->lock, flags);
+    memcpy(sq->insns, insns, prog->ninsns * sizeof(*insns));
+    sq->ninsns = prog->ninsns;
+    sq->pins = pins;
+    sq->steps_per_tick = prog->steps_per_tick;
+    sq->period_ns = prog->period_ns;
+    sq->pc = 0;
+    sq->x = 0;
+    sq->isr = 0;
+    sq->delay = 0;
+    kfifo_reset(&sq->fifo);
+    sq->ticks = 0;
+    sq->steps = 0;
+    sq->stall_ticks = 0;
+    sq->budget_ticks = 0;
+    sq->late_ticks = 0;
+    sq->fifo_overflows = 0;
+    sq->state = GPIO_SEQ_RUNNING;
+    spin_unlock_irqrestore(&sq->lock, flags);
+
+    hrtimer_start(&sq->timer, ns_to_ktime(sq->period_ns), HRTIMER_MODE_REL_HARD);
+    mutex_unlock(&gpio_dev->seq_mutex);
+
+    kfree(insns);
+    return 0;
+}
+
+static int gpio_seq_status(struct gpio_device *gpio_dev, struct gpio_seq_status *status)
+{
+    struct gpio_seq *sq;
+    unsigned long flags;
+    u32 index = status->index;
+
+    if (index >= GPIO_SEQ_MAX)
+        return -EINVAL;
+    sq = &gpio_dev->seq[index];
+
+    memset(status, 0, sizeof(*status));
+    status->index = index;
+
+    spin_lock_irqsave(&sq->lock, flags);
+    status->state = sq->state;
+    status->pc = sq->pc;
+    status->x = sq->x;
+    status->isr = sq->isr;
+    status->fifo_level = kfifo_len(&sq->fifo);
+    status->ticks = sq->ticks;
+    status->steps = sq->steps;
+    status->stall_ticks = sq->stall_ticks;
+    status->budget_ticks = sq->budget_ticks;
+    status->late_ticks = sq->late_ticks;
+    status->fifo_overflows = sq->fifo_overflows;
+    spin_unlock_irqrestore(&sq->lock, flags);
+
+    return 0;
+}
+
+/* Drain the FIFO; a PUSH stalled on it proceeds on the next tick */
+static int gpio_seq_pop(struct gpio_device *gpio_dev, struct gpio_seq_fifo *fifo)
+{
+    struct gpio_seq *sq;
+    unsigned long flags;
+
+    if (fifo->index >= GPIO_SEQ_MAX)
+        return -EINVAL;
+    sq = &gpio_dev->seq[fifo->index];
+    memset(fifo->values, 0, sizeof(fifo->values));
+
+    spin_lock_irqsave(&sq->lock, flags);
+    fifo->count = kfifo_out(&sq->fifo, fifo->values, GPIO_SEQ_FIFO_SIZE);
+    spin_unlock_irqrestore(&sq->lock, flags);
+
+    return 0;
+}
+
+/* Read-only view of the run buffer at GPIO_CAPTURE_MMAP_OFFSET */
+static int gpio_capture_mmap(struct gpio_device *gpio_dev, struct vm_area_struct *vma)
+{
+    struct gpio_capture *cap = &gpio_dev->capture;
+    unsigned long size = vma->vm_end - vma->vm_start;
+    int ret = -ENODATA;
+
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    if (size > GPIO_CAPTURE_RUNS * sizeof(struct gpio_capture_run))
+        return -EINVAL;
+    /* The timer reads the runs back, mprotect() must not make them writable */
+    vm_flags_clear(vma, VM_MAYWRITE);
+
+    mutex_lock(&cap->mutex);
+    if (cap->runs)
+        ret = remap_vmalloc_range(vma, cap->runs, 0);
+    mutex_unlock(&cap->mutex);
+
+    return ret;
+}
+
+static ssize_t gpio_read(struct file *filp, char __user *buf, size_t count, 
+                         loff_t *ppos)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    ssize_t copied;
+    int ret;
+
+    if (count < sizeof(struct gpio_event))
+        return -EINVAL;
+
+    do {
+        if (gpio_event_ring_empty(gpio_dev)) {
+            if (filp->f_flags & O_NONBLOCK)
+                return -EAGAIN;
+            ret = wait_event_interruptible(gpio_dev->event_wait, 
+                                           !gpio_event_ring_empty(gpio_dev));
+            if (ret)
+                return ret;
+        }
+
+        if (mutex_lock_interruptible(&gpio_dev->read_lock))
+            return -ERESTARTSYS;
+        copied = gpio_event_copy_out(gpio_dev, buf, count / sizeof(struct gpio_event));
+        mutex_unlock(&gpio_dev->read_lock);
+    } while (copied == 0);  /* another reader got there first */
+
+    return copied;
+}
+
+static __poll_t gpio_poll(struct file *filp, poll_table *wait)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+
+    __poll_t mask = 0;
+
+    poll_wait(filp, &gpio_dev->event_wait, wait);
+    poll_wait(filp, &gpio_dev->out_wait, wait);
+
+    if (!gpio_event_ring_empty(gpio_dev))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (gpio_out_space(gpio_dev))
+        mask |= EPOLLOUT | EPOLLWRNORM;
+    return mask;
+}
+
+/*
+ * Map the event ring, consumers advance ring->tail themselves; or the
+ * capture buffer at its own offset.
+ */
+static int gpio_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    unsigned long size = vma->vm_end - vma->vm_start;
+
+    if (!(vma->vm_flags & VM_SHARED))
+        return -EINVAL;
+    if (vma->vm_pgoff == GPIO_CAPTURE_MMAP_OFFSET >> PAGE_SHIFT)
+        return gpio_capture_mmap(gpio_dev, vma);
+    if (vma->vm_pgoff != 0 || size > gpio_dev->ring_bytes)
+        return -EINVAL;
+
+    return remap_vmalloc_range(vma, gpio_dev->ring, 0);
+}
+
+static long __gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    struct gpio_config config;
+    struct gpio_bank_state state;
+    struct gpio_mask mask;
+    struct gpio_event_stats event_stats;
+    struct gpio_irq_stats irq_stats;
+    struct gpio_reflex reflex;
+    struct gpio_reflex_stats reflex_stats;
+    struct gpio_pwm pwm;
+    struct gpio_pwm_stats pwm_stats;
+    struct gpio_out_stats out_stats;
+    u32 out_mode;
+    struct gpio_capture_config capture_cfg;
+    struct gpio_capture_status capture_status;
+    struct gpio_seq_program seq_prog;
+    struct gpio_seq_status seq_status;
+    struct gpio_seq_fifo seq_fifo;
+    int ret = 0;
+
+    switch (cmd) {
+    case GPIO_SET_DIRECTION:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_set_direction(gpio_dev, config.gpio_num, config.value);
+        break;
+
+    case GPIO_READ_PIN:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_read_pin(gpio_dev, config.gpio_num, &config.value);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_config __user *)arg, &config, 
+                            sizeof(config)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_WRITE_PIN:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_write_pin(gpio_dev, config.gpio_num, config.value);
+        break;
+
+    case GPIO_SET_INTERRUPT:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_set_interrupt(gpio_dev, config.gpio_num, config.value);
+        break;
+
+    case GPIO_SET_EDGE:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_set_edge(gpio_dev, config.gpio_num, config.value);
+        break;
+
+    case GPIO_SET_DEBOUNCE:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_set_debounce(gpio_dev, config.gpio_num, config.value);
+        break;
+
+    case GPIO_READ_INT_STATUS:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_read_int_status(gpio_dev, config.gpio_num, &config.value);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_config __user *)arg, &config, 
+                            sizeof(config)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_CLEAR_INT_STATUS:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_clear_int_status(gpio_dev, config.gpio_num);
+        break;
+
+    case GPIO_BATCH:
+        ret = gpio_batch(gpio_dev, (struct gpio_batch __user *)arg);
+        break;
+
+    case GPIO_XFER:
+        ret = gpio_xfer(gpio_dev, (struct gpio_xfer __user *)arg);
+        break;
+
+    case GPIO_READ_ALL:
+        ret = gpio_read_all(gpio_dev, &state);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_bank_state __user *)arg, &state, 
+                            sizeof(state)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_WRITE_MASK:
+        if (copy_from_user(&mask, (struct gpio_mask __user *)arg, 
+                          sizeof(mask)))
+            return -EFAULT;
+        ret = gpio_write_mask(gpio_dev, mask.mask, mask.value);
+        break;
+
+    case GPIO_SYNC_SHADOW:
+        ret = gpio_sync_shadow(gpio_dev);
+        break;
+
+    case GPIO_GET_EVENT_STATS:
+        ret = gpio_get_event_stats(gpio_dev, &event_stats);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_event_stats __user *)arg, 
+                            &event_stats, sizeof(event_stats)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_GET_IRQ_STATS:
+        ret = gpio_get_irq_stats(gpio_dev, &irq_stats);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_irq_stats __user *)arg, 
+                            &irq_stats, sizeof(irq_stats)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_GET_STATS:
+        ret = gpio_get_stats(gpio_dev, (struct gpio_stats __user *)arg);
+        break;
+
+    case GPIO_SET_REFLEX:
+        if (copy_from_user(&reflex, (struct gpio_reflex __user *)arg, 
+                          sizeof(reflex)))
+            return -EFAULT;
+        ret = gpio_set_reflex(gpio_dev, &reflex);
+        break;
+
+    case GPIO_GET_REFLEX_STATS:
+        if (copy_from_user(&reflex_stats, (struct gpio_reflex_stats __user *)arg, 
+                          sizeof(reflex_stats)))
+            return -EFAULT;
+        ret = gpio_get_reflex_stats(gpio_dev, &reflex_stats);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_reflex_stats __user *)arg, 
+                            &reflex_stats, sizeof(reflex_stats)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_SET_PWM:
+        if (copy_from_user(&pwm, (struct gpio_pwm __user *)arg, sizeof(pwm)))
+            return -EFAULT;
+        ret = gpio_set_pwm(gpio_dev, &pwm);
+        break;
+
+    case GPIO_GET_PWM_STATS:
+        if (copy_from_user(&pwm_stats, (struct gpio_pwm_stats __user *)arg, 
+                          sizeof(pwm_stats)))
+            return -EFAULT;
+        ret = gpio_get_pwm_stats(gpio_dev, &pwm_stats);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_pwm_stats __user *)arg, 
+                            &pwm_stats, sizeof(pwm_stats)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_SET_OUT_MODE:
+        if (get_user(out_mode, (u32 __user *)arg))
+            return -EFAULT;
+        ret = gpio_set_out_mode(gpio_dev, out_mode);
+        break;
+
+    case GPIO_GET_OUT_STATS:
+        ret = gpio_get_out_stats(gpio_dev, &out_stats);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_out_stats __user *)arg, 
+                            &out_stats, sizeof(out_stats)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_CAPTURE_START:
+        if (copy_from_user(&capture_cfg, (struct gpio_capture_config __user *)arg, 
+                          sizeof(capture_cfg)))
+            return -EFAULT;
+        ret = gpio_capture_start(gpio_dev, &capture_cfg);
+        break;
+
+    case GPIO_CAPTURE_STOP:
+        ret = gpio_capture_stop(gpio_dev);
+        break;
+
+    case GPIO_CAPTURE_STATUS:
+        ret = gpio_capture_status(gpio_dev, &capture_status);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_capture_status __user *)arg, 
+                            &capture_status, sizeof(capture_status)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_SET_COUNTER:
+        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
+                          sizeof(config)))
+            return -EFAULT;
+        ret = gpio_set_counter(gpio_dev, config.gpio_num, config.value);
+        break;
+
+    case GPIO_GET_COUNTERS:
+        ret = gpio_get_counters(gpio_dev, (struct gpio_counters __user *)arg);
+        break;
+
+    case GPIO_SEQ_LOAD_PROG:
+        if (copy_from_user(&seq_prog, (struct gpio_seq_program __user *)arg, 
+                          sizeof(seq_prog)))
+            return -EFAULT;
+        ret = gpio_seq_load(gpio_dev, &seq_prog);
+        break;
+
+    case GPIO_SEQ_GET_STATUS:
+        if (copy_from_user(&seq_status, (struct gpio_seq_status __user *)arg, 
+                          sizeof(seq_status)))
+            return -EFAULT;
+        ret = gpio_seq_status(gpio_dev, &seq_status);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_seq_status __user *)arg, 
+                            &seq_status, sizeof(seq_status)))
+                return -EFAULT;
+        }
+        break;
+
+    case GPIO_SEQ_POP:
+        if (copy_from_user(&seq_fifo.index, (__u32 __user *)arg, sizeof(seq_fifo.index)))
+            return -EFAULT;
+        ret = gpio_seq_pop(gpio_dev, &seq_fifo);
+        if (ret == 0) {
+            if (copy_to_user((struct gpio_seq_fifo __user *)arg, 
+                            &seq_fifo, sizeof(seq_fifo)))
+                return -EFAULT;
+        }
+        break;
+
+    default:
+        return -ENOTTY;
+    }
+
+    return ret;
+}
+
+static long gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    u64 start = ktime_get_ns();
+    u64 duration;
+    long ret;
+
+    trace_gpio_ioctl_enter(cmd, arg);
+    ret = __gpio_ioctl(filp, cmd, arg);
+    duration = ktime_get_ns() - start;
+    trace_gpio_ioctl_exit(cmd, ret, duration);
+
+    gpio_stats_cmd(gpio_dev, cmd, ret);
+    gpio_hist_add(ioctl, duration);
+    return ret;
+}
+
+static const struct file_operations gpio_fops = {
+    .owner = THIS_MODULE,
+    .open = gpio_open,
+    .release = gpio_release,
+    .read = gpio_read,
+    .write = gpio_write,
+    .poll = gpio_poll,
+    .mmap = gpio_mmap,
+    .unlocked_ioctl = gpio_ioctl,
+};
+
+/*
+ * gpiolib callbacks, so the bank also shows up as /dev/gpiochipN. They
+ * share the pin locks and shadow with the ioctls above.
+ */
+static int gpio_chip_get_direction(struct gpio_chip *chip, unsigned int offset)
+{
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+
+    if (gpio_cfg_read(gpio_dev, offset) & GPIO_DIR_BIT)
+        return GPIO_LINE_DIRECTION_OUT;
+    return GPIO_LINE_DIRECTION_IN;
+}
+
+static int gpio_chip_direction_input(struct gpio_chip *chip, unsigned int offset)
+{
+    return gpio_set_direction(gpiochip_get_data(chip), offset, GPIO_DIR_INPUT);
+}
+
+static int gpio_chip_direction_output(struct gpio_chip *chip, unsigned int offset, 
+                                      int value)
+{
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    unsigned long flags;
+    u32 reg_val;
+
+    /* Level and direction go out in one write, the pin never glitches */
+    spin_lock_irqsave(&gpio_dev->pins[offset].lock, flags);
+    reg_val = gpio_cfg_read(gpio_dev, offset);
+    if (!(reg_val & GPIO_DIR_BIT))
+        gpio_pin_stat_inc(offset, direction_changes);
+
+    reg_val |= GPIO_DIR_BIT;
+    if (value)
+        reg_val |= GPIO_DATA_BIT;
+    else
+        reg_val &= ~GPIO_DATA_BIT;
+
+    gpio_cfg_write(gpio_dev, offset, reg_val);
+    gpio_pin_stat_inc(offset, writes);
+    spin_unlock_irqrestore(&gpio_dev->pins[offset].lock, flags);
+
+    return 0;
+}
+
+static int gpio_chip_get(struct gpio_chip *chip, unsigned int offset)
+{
+    int value, ret;
+
+    ret = gpio_read_pin(gpiochip_get_data(chip), offset, &value);
+    return ret ? ret : value;
+}
+
+static int gpio_chip_set(struct gpio_chip *chip, unsigned int offset, int value)
+{
+    return gpio_write_pin(gpiochip_get_data(chip), offset, value);
+}
+
+/* Bulk access takes the locks once for all lines, like GPIO_READ_ALL */
+static int gpio_chip_get_multiple(struct gpio_chip *chip, unsigned long *mask, 
+                                  unsigned long *bits)
+{
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    unsigned long flags;
+    int i;
+
+    gpio_lock_pins(gpio_dev, *mask, &flags);
+    for_each_set_bit(i, mask, gpio_dev->ngpio) {
+        __assign_bit(i, bits, __gpio_read_pin(gpio_dev, i));
+        gpio_pin_stat_inc(i, reads);
+    }
+    gpio_unlock_pins(gpio_dev, *mask, flags);
+
+    return 0;
+}
+
+/*
+ * A line can still have been turned into an input through /dev, so this
+ * is all or nothing like GPIO_WRITE_MASK, -EPERM if any line is not an output.
+ */
+static int gpio_chip_set_multiple(struct gpio_chip *chip, unsigned long *mask, 
+                                  unsigned long *bits)
+{
+    return gpio_write_mask(gpiochip_get_data(chip), *mask, *bits);
+}
+
+/*
+ * irq_chip of the per-pin virtual IRQs. The bank interrupt is demuxed by
+ * __gpio_irq_handler(), so there is no chained parent handler.
+ */
+static void gpio_irq_mask(struct irq_data *d)
+{
+    struct gpio_chip *chip = irq_data_get_irq_chip_data(d);
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    irq_hw_number_t hwirq = irqd_to_hwirq(d);
+    unsigned long flags;
+
+    spin_lock_irqsave(&gpio_dev->pins[hwirq].lock, flags);
+    __gpio_set_interrupt(gpio_dev, hwirq, GPIO_INT_DISABLE);
+    spin_unlock_irqrestore(&gpio_dev->pins[hwirq].lock, flags);
+    gpiochip_disable_irq(chip, hwirq);
+}
+
+static void gpio_irq_unmask(struct irq_data *d)
+{
+    struct gpio_chip *chip = irq_data_get_irq_chip_data(d);
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    irq_hw_number_t hwirq = irqd_to_hwirq(d);
+    unsigned long flags;
+
+    gpiochip_enable_irq(chip, hwirq);
+    spin_lock_irqsave(&gpio_dev->pins[hwirq].lock, flags);
+    __gpio_set_interrupt(gpio_dev, hwirq, GPIO_INT_ENABLE);
+    spin_unlock_irqrestore(&gpio_dev->pins[hwirq].lock, flags);
+}
+
+/* W1TC of the status bit */
+static void gpio_irq_ack(struct irq_data *d)
+{
+    struct gpio_chip *chip = irq_data_get_irq_chip_data(d);
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    irq_hw_number_t hwirq = irqd_to_hwirq(d);
+    unsigned long flags;
+
+    spin_lock_irqsave(&gpio_dev->pins[hwirq].lock, flags);
+    /* Acked by the flow handler, in hard-IRQ context */
+    __gpio_clear_int_status(gpio_dev, hwirq, true);
+    spin_unlock_irqrestore(&gpio_dev->pins[hwirq].lock, flags);
+}
+
+/* The bank flags any change, the type is applied by the edge filter */
+static int gpio_irq_set_type(struct irq_data *d, unsigned int type)
+{
+    struct gpio_chip *chip = irq_data_get_irq_chip_data(d);
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    irq_hw_number_t hwirq = irqd_to_hwirq(d);
+    unsigned long flags;
+    int edge;
+
+    switch (type & IRQ_TYPE_SENSE_MASK) {
+    case IRQ_TYPE_EDGE_RISING:
+        edge = GPIO_EDGE_RISING;
+        break;
+    case IRQ_TYPE_EDGE_FALLING:
+        edge = GPIO_EDGE_FALLING;
+        break;
+    case IRQ_TYPE_EDGE_BOTH:
+        edge = GPIO_EDGE_BOTH;
+        break;
+    case IRQ_TYPE_LEVEL_HIGH:
+        edge = GPIO_EDGE_LEVEL_HIGH;
+        break;
+    case IRQ_TYPE_LEVEL_LOW:
+        edge = GPIO_EDGE_LEVEL_LOW;
+        break;
+    default:
+        return -EINVAL;
+    }
+
+    spin_lock_irqsave(&gpio_dev->pins[hwirq].lock, flags);
+    __gpio_set_edge(gpio_dev, hwirq, edge);
+    spin_unlock_irqrestore(&gpio_dev->pins[hwirq].lock, flags);
+
+    if (type & IRQ_TYPE_LEVEL_MASK)
+        irq_set_handler_locked(d, handle_level_irq);
+    else
+        irq_set_handler_locked(d, handle_edge_irq);
+    return 0;
+}
+
+static int gpio_irq_reqres(struct irq_data *d)
+{
+    struct gpio_chip *chip = irq_data_get_irq_chip_data(d);
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    irq_hw_number_t hwirq = irqd_to_hwirq(d);
+    int ret;
+
+    ret = gpiochip_reqres_irq(chip, hwirq);
+    if (ret)
+        return ret;
+
+    /* From now on the pin is delivered to its virtual IRQ, not to read() */
+    gpio_set_debounce(gpio_dev, hwirq, 0);
+    clear_bit(hwirq, &gpio_dev->counting);
+    set_bit(hwirq, &gpio_dev->irq_claimed);
+    return 0;
+}
+
+static void gpio_irq_relres(struct irq_data *d)
+{
+    struct gpio_chip *chip = irq_data_get_irq_chip_data(d);
+    struct gpio_device *gpio_dev = gpiochip_get_data(chip);
+    irq_hw_number_t hwirq = irqd_to_hwirq(d);
+
+    clear_bit(hwirq, &gpio_dev->irq_claimed);
+    gpiochip_relres_irq(chip, hwirq);
+}
+
+static const struct irq_chip gpio_irq_chip = {
+    .name = DRIVER_NAME,
+    .irq_ack = gpio_irq_ack,
+    .irq_mask = gpio_irq_mask,
+    .irq_unmask = gpio_irq_unmask,
+    .irq_set_type = gpio_irq_set_type,
+    .irq_request_resources = gpio_irq_reqres,
+    .irq_release_resources = gpio_irq_relres,
+    .flags = IRQCHIP_IMMUTABLE,
+};
+
+static int gpio_chip_register(struct gpio_device *gpio_dev, bool has_irq)
+{
+    struct gpio_chip *chip = &gpio_dev->chip;
+    struct gpio_irq_chip *girq;
+
+    chip->label = dev_name(gpio_dev->dev);
+    chip->parent = gpio_dev->dev;
+    chip->owner = THIS_MODULE;
+    chip->base = -1;
+    chip->ngpio = gpio_dev->ngpio;
+    chip->can_sleep = false;
+    chip->get_direction = gpio_chip_get_direction;
+    chip->direction_input = gpio_chip_direction_input;
+    chip->direction_output = gpio_chip_direction_output;
+    chip->get = gpio_chip_get;
+    chip->set = gpio_chip_set;
+    chip->get_multiple = gpio_chip_get_multiple;
+    chip->set_multiple = gpio_chip_set_multiple;
+
+    /* Per-pin IRQs only make sense when the bank interrupt can fire */
+    if (has_irq) {
+        girq = &chip->irq;
+        gpio_irq_chip_set_chip(girq, &gpio_irq_chip);
+        girq->parent_handler = NULL;
+        girq->num_parents = 0;
+        girq->parents = NULL;
+        girq->default_type = IRQ_TYPE_NONE;
+        girq->handler = handle_bad_irq;
+    }
+
+    return gpiochip_add_data(chip, gpio_dev);
+}
+
+/* debugfs sim_inputs: read the input levels, write "<gpio> <level>" */
+static ssize_t gpio_sim_inputs_read(struct file *filp, char __user *buf, 
+                                    size_t count, loff_t *ppos)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    char kbuf[16];
+    int len;
+
+    len = scnprintf(kbuf, sizeof(kbuf), "0x%02x\n", READ_ONCE(gpio_dev->sim->inputs));
+    return simple_read_from_buffer(buf, count, ppos, kbuf, len);
+}
+
+static ssize_t gpio_sim_inputs_write(struct file *filp, const char __user *buf, 
+                                     size_t count, loff_t *ppos)
+{
+    struct gpio_device *gpio_dev = filp->private_data;
+    char kbuf[32];
+    int gpio_num, level;
+
+    if (count >= sizeof(kbuf))
+        return -EINVAL;
+    if (copy_from_user(kbuf, buf, count))
+        return -EFAULT;
+    kbuf[count] = '\0';
+
+    if (sscanf(kbuf, "%d %d", &gpio_num, &level) != 2)
+        return -EINVAL;
+    if (gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+
+    gpio_sim_set_input(gpio_dev, gpio_num, level);
+    return count;
+}
+
+static const struct file_operations gpio_sim_inputs_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .read = gpio_sim_inputs_read,
+    .write = gpio_sim_inputs_write,
+};
+
+/*
+ * debugfs sim_stimulus, one command per write:
+ *   square <gpio> <hz>             50% duty square wave
+ *   poisson <gpio> <edges/s>       random edge train at the given mean rate
+ *   burst <gpio> <edges> <gap_ns>  fixed number of edges, then stop
+ *   stop <gpio>|all
+ */
+static int gpio_sim_stim_show(struct seq_file *s, void *unused)
+{
+    static const char * const modes[] = { "off", "square", "poisson", "burst" };
+    struct gpio_device *gpio_dev = s->private;
+    struct gpio_sim *gs = gpio_dev->sim;
+    int i;
 
-    spin_lock_irqsave(&gpio_dev->lock, flags);
-    reg_val = gpio_read_reg(gpio_num);
-    
-    if (direction)
-        reg_val |= GPIO_DIR_BIT;  
-    else
-        reg_val &= ~GPIO_DIR_BIT; 
-    
-    gpio_write_reg(gpio_num, reg_val);
-    spin_unlock_irqrestore(&gpio_dev->lock, flags);
+    seq_printf(s, "%4s %8s %12s %14s %10s\n", "gpio", "mode", "interval_ns", 
+               "edges", "missed");
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        struct gpio_sim_stim *st = &gs->stim[i];
 
+        seq_printf(s, "%4d %8s %12llu %14llu %10llu\n", i, 
+                   modes[READ_ONCE(st->mode)], st->interval_ns, 
+                   READ_ONCE(st->edges), READ_ONCE(st->missed));
+    }
     return 0;
 }
 
-static int gpio_read_pin(int gpio_num, int *value)
+static int gpio_sim_stim_open(struct inode *inode, struct file *filp)
 {
-    u32 reg_val;
-    unsigned long flags;
+    return single_open(filp, gpio_sim_stim_show, inode->i_private);
+}
+
+static ssize_t gpio_sim_stim_write(struct file *filp, const char __user *buf, 
+                                   size_t count, loff_t *ppos)
+{
+    struct gpio_device *gpio_dev = ((struct seq_file *)filp->private_data)->private;
+    struct gpio_sim *gs = gpio_dev->sim;
+    char kbuf[64], cmd[16];
+    unsigned long long arg1 = 0, arg2 = 0;
+    int gpio_num, n, i;
 
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
+    if (count >= sizeof(kbuf))
         return -EINVAL;
+    if (copy_from_user(kbuf, buf, count))
+        return -EFAULT;
+    kbuf[count] = '\0';
 
-    spin_lock_irqsave(&gpio_dev->lock, flags);
-    reg_val = gpio_read_reg(gpio_num);
-    *value = (reg_val & GPIO_DATA_BIT) ? 1 : 0;
-    spin_unlock_irqrestore(&gpio_dev->lock, flags);
+    if (sscanf(kbuf, "stop %15s", cmd) == 1 && !strcmp(cmd, "all")) {
+        mutex_lock(&gs->stim_lock);
+        for (i = 0; i < gpio_dev->ngpio; i++)
+            __gpio_stim_set(gpio_dev, i, GPIO_STIM_OFF, 0, 0);
+        mutex_unlock(&gs->stim_lock);
+        return count;
+    }
 
-    return 0;
+    n = sscanf(kbuf, "%15s %d %llu %llu", cmd, &gpio_num, &arg1, &arg2);
+    if (n < 2 || gpio_num < 0 || gpio_num >= gpio_dev->ngpio)
+        return -EINVAL;
+
+    mutex_lock(&gs->stim_lock);
+    if (!strcmp(cmd, "stop")) {
+        __gpio_stim_set(gpio_dev, gpio_num, GPIO_STIM_OFF, 0, 0);
+    } else if (!strcmp(cmd, "square") && n == 3 && arg1 && 
+               arg1 <= NSEC_PER_SEC / (2 * GPIO_STIM_MIN_NS)) {
+        __gpio_stim_set(gpio_dev, gpio_num, GPIO_STIM_SQUARE, 
+                        div_u64(NSEC_PER_SEC, 2 * arg1), 0);
+    } else if (!strcmp(cmd, "poisson") && n == 3 && arg1 && 
+               arg1 <= NSEC_PER_SEC / GPIO_STIM_MIN_NS) {
+        __gpio_stim_set(gpio_dev, gpio_num, GPIO_STIM_POISSON, 
+                        div_u64(NSEC_PER_SEC, arg1), 0);
+    } else if (!strcmp(cmd, "burst") && n == 4 && arg1 && arg1 <= U32_MAX && 
+               arg2 >= GPIO_STIM_MIN_NS && arg2 <= NSEC_PER_SEC) {
+        __gpio_stim_set(gpio_dev, gpio_num, GPIO_STIM_BURST, arg2, arg1);
+    } else {
+        count = -EINVAL;
+    }
+    mutex_unlock(&gs->stim_lock);
+
+    return count;
 }
 
-static int gpio_write_pin(int gpio_num, int value)
+static const struct file_operations gpio_sim_stim_fops = {
+    .owner = THIS_MODULE,
+    .open = gpio_sim_stim_open,
+    .read = seq_read,
+    .write = gpio_sim_stim_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/* debugfs stats: the GPIO_GET_STATS counters as tables */
+static int gpio_stats_show(struct seq_file *s, void *unused)
 {
-    u32 reg_val;
-    unsigned long flags;
+    static const char * const cmd_names[GPIO_STATS_NR_CMDS] = {
+        [_IOC_NR(GPIO_SET_DIRECTION)] = "set_direction",
+        [_IOC_NR(GPIO_READ_PIN)] = "read_pin",
+        [_IOC_NR(GPIO_WRITE_PIN)] = "write_pin",
+        [_IOC_NR(GPIO_SET_INTERRUPT)] = "set_interrupt",
+        [_IOC_NR(GPIO_READ_INT_STATUS)] = "read_int_status",
+        [_IOC_NR(GPIO_CLEAR_INT_STATUS)] = "clear_int_status",
+        [_IOC_NR(GPIO_BATCH)] = "batch",
+        [_IOC_NR(GPIO_READ_ALL)] = "read_all",
+        [_IOC_NR(GPIO_WRITE_MASK)] = "write_mask",
+        [_IOC_NR(GPIO_SYNC_SHADOW)] = "sync_shadow",
+        [_IOC_NR(GPIO_GET_EVENT_STATS)] = "get_event_stats",
+        [_IOC_NR(GPIO_GET_IRQ_STATS)] = "get_irq_stats",
+        [_IOC_NR(GPIO_SET_EDGE)] = "set_edge",
+        [_IOC_NR(GPIO_SET_DEBOUNCE)] = "set_debounce",
+        [_IOC_NR(GPIO_GET_STATS)] = "get_stats",
+        [_IOC_NR(GPIO_SET_REFLEX)] = "set_reflex",
+        [_IOC_NR(GPIO_GET_REFLEX_STATS)] = "get_reflex_stats",
+        [_IOC_NR(GPIO_SET_PWM)] = "set_pwm",
+        [_IOC_NR(GPIO_GET_PWM_STATS)] = "get_pwm_stats",
+        [_IOC_NR(GPIO_SET_OUT_MODE)] = "set_out_mode",
+        [_IOC_NR(GPIO_GET_OUT_STATS)] = "get_out_stats",
+        [_IOC_NR(GPIO_CAPTURE_START)] = "capture_start",
+        [_IOC_NR(GPIO_CAPTURE_STOP)] = "capture_stop",
+        [_IOC_NR(GPIO_CAPTURE_STATUS)] = "capture_status",
+        [_IOC_NR(GPIO_XFER)] = "xfer",
+        [_IOC_NR(GPIO_SEQ_LOAD_PROG)] = "seq_load_prog",
+        [_IOC_NR(GPIO_SEQ_GET_STATUS)] = "seq_get_status",
+        [_IOC_NR(GPIO_SEQ_POP)] = "seq_pop",
+        [_IOC_NR(GPIO_SET_COUNTER)] = "set_counter",
+        [_IOC_NR(GPIO_GET_COUNTERS)] = "get_counters",
+    };
+    struct gpio_device *gpio_dev = s->private;
+    struct gpio_stats *stats;
+    int i;
 
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
-        return -EINVAL;
+    stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+    if (!stats)
+        return -ENOMEM;
+    gpio_stats_sum(gpio_dev, stats);
 
-    spin_lock_irqsave(&gpio_dev->lock, flags);
-    reg_val = gpio_read_reg(gpio_num);
-    
-    if (!(reg_val & GPIO_DIR_BIT)) {
-        spin_unlock_irqrestore(&gpio_dev->lock, flags);
-        return -EPERM; /* bu if blogu pinin input oldugu casedir */
+    seq_printf(s, "%4s %12s %12s %8s %12s %12s %8s %8s\n", "gpio", "reads", 
+               "writes", "dir_chg", "irqs", "irqs_clr", "eperm", "einval");
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        struct gpio_pin_stats *ps = &stats->pins[i];
+
+        seq_printf(s, "%4d %12llu %12llu %8llu %12llu %12llu %8llu %8llu\n", i, 
+                   ps->reads, ps->writes, ps->direction_changes, ps->irqs, 
+                   ps->irqs_cleared, ps->eperm, ps->einval);
     }
-    
-    if (value)
-        reg_val |= GPIO_DATA_BIT;
-    else
-        reg_val &= ~GPIO_DATA_BIT;
-    
-    gpio_write_reg(gpio_num, reg_val);
-    spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
+    seq_printf(s, "\n%-18s %12s %8s %8s\n", "ioctl", "calls", "eperm", "einval");
+    for (i = 0; i < GPIO_STATS_NR_CMDS; i++) {
+        if (!cmd_names[i])
+            continue;
+        seq_printf(s, "%-18s %12llu %8llu %8llu\n", cmd_names[i], 
+                   stats->cmds[i].calls, stats->cmds[i].eperm, stats->cmds[i].einval);
+    }
+
+    seq_printf(s, "\nlock_acquisitions %llu\nlock_hold_ns %llu\n", 
+               stats->lock_acquisitions, stats->lock_hold_ns);
+
+    kfree(stats);
     return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(gpio_stats);
 
-static int gpio_set_interrupt(int gpio_num, int enable)
+/* debugfs latency_hist: log2 buckets in ns, any write resets them */
+static int gpio_hist_show(struct seq_file *s, void *unused)
 {
-    u32 reg_val;
-    unsigned long flags;
-
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
-        return -EINVAL;
+    struct gpio_device *gpio_dev = s->private;
+    u64 ioctl, irq, irq_thread;
+    struct gpio_latency_hist *h;
+    int b, cpu;
 
-    spin_lock_irqsave(&gpio_dev->lock, flags);
-    reg_val = gpio_read_reg(gpio_num);
-    
-    if (enable)
-        reg_val |= GPIO_INT_ENABLE_BIT;
-    else
-        reg_val &= ~GPIO_INT_ENABLE_BIT;
-    
-    gpio_write_reg(gpio_num, reg_val);
-    spin_unlock_irqrestore(&gpio_dev->lock, flags);
+    seq_printf(s, "%-24s %12s %12s %12s\n", "ns", "ioctl", "irq", "irq_thread");
+    for (b = 0; b < GPIO_HIST_BUCKETS; b++) {
+        ioctl = irq = irq_thread = 0;
+        for_each_possible_cpu(cpu) {
+            h = per_cpu_ptr(gpio_dev->hist, cpu);
+            ioctl += h->ioctl[b];
+            irq += h->irq[b];
+            irq_thread += h->irq_thread[b];
+        }
+        if (!ioctl && !irq && !irq_thread)
+            continue;
 
+        if (b == GPIO_HIST_BUCKETS - 1)
+            seq_printf(s, "%11llu - %-10s %12llu %12llu %12llu\n", 1ULL << b, "inf", 
+                       ioctl, irq, irq_thread);
+        else
+            seq_printf(s, "%11llu - %-10llu %12llu %12llu %12llu\n", 1ULL << b, 
+                       (2ULL << b) - 1, ioctl, irq, irq_thread);
+    }
     return 0;
 }
 
-static int gpio_read_int_status(int gpio_num, int *status)
+static int gpio_hist_open(struct inode *inode, struct file *filp)
 {
-    u32 reg_val;
-    unsigned long flags;
-
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
-        return -EINVAL;
+    return single_open(filp, gpio_hist_show, inode->i_private);
+}
 
-    spin_lock_irqsave(&gpio_dev->lock, flags);
-    reg_val = gpio_read_reg(gpio_num);
-    *status = (reg_val & GPIO_INT_STATUS_BIT) ? 1 : 0;
-    spin_unlock_irqrestore(&gpio_dev->lock, flags);
+/* Racy against concurrent updates, a count or two may survive */
+static ssize_t gpio_hist_write(struct file *filp, const char __user *buf, 
+                               size_t count, loff_t *ppos)
+{
+    struct gpio_device *gpio_dev = ((struct seq_file *)filp->private_data)->private;
+    int cpu;
 
-    return 0;
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(gpio_dev->hist, cpu), 0, sizeof(struct gpio_latency_hist));
+    return count;
 }
 
-static int gpio_clear_int_status(int gpio_num)
+static const struct file_operations gpio_hist_fops = {
+    .owner = THIS_MODULE,
+    .open = gpio_hist_open,
+    .read = seq_read,
+    .write = gpio_hist_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+static int gpio_sim_init(struct gpio_device *gpio_dev)
 {
-    u32 reg_val;
-    unsigned long flags;
+    struct gpio_sim *gs;
+    int i;
 
-    if (gpio_num < 0 || gpio_num >= NUM_GPIOS)
-        return -EINVAL;
+    gs = kzalloc(sizeof(*gs), GFP_KERNEL);
+    if (!gs)
+        return -ENOMEM;
 
-    spin_lock_irqsave(&gpio_dev->lock, flags);
-    reg_val = gpio_read_reg(gpio_num);
-    
-    /* W1TC */
-    if (reg_val & GPIO_INT_STATUS_BIT) {
-        gpio_write_reg(gpio_num, GPIO_INT_STATUS_BIT);
+    spin_lock_init(&gs->lock);
+    mutex_init(&gs->stim_lock);
+    gs->irq = -1;
+
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        gs->stim[i].gpio_dev = gpio_dev;
+        gs->stim[i].gpio_num = i;
+        hrtimer_setup(&gs->stim[i].timer, gpio_stim_timer, CLOCK_MONOTONIC, 
+                      HRTIMER_MODE_REL_HARD);
     }
-    
-    spin_unlock_irqrestore(&gpio_dev->lock, flags);
 
+#if IS_ENABLED(CONFIG_IRQ_SIM)
+    /* irq_sim raises the interrupt from irq_work, like a real line would */
+    gs->domain = irq_domain_create_sim(NULL, 1);
+    if (IS_ERR(gs->domain)) {
+        pr_warn("GPIO Driver: No simulated IRQ domain (error %ld)\n", 
+                PTR_ERR(gs->domain));
+        gs->domain = NULL;
+    } else {
+        gs->irq = irq_create_mapping(gs->domain, 0);
+        if (!gs->irq)
+            gs->irq = -1;
+    }
+#endif
+
+    gpio_dev->sim = gs;
+    static_branch_inc(&gpio_sim_active);
     return 0;
 }
 
-static irqreturn_t gpio_irq_handler(int irq, void *dev_id)
+static void gpio_sim_exit(struct gpio_device *gpio_dev)
 {
+    struct gpio_sim *gs = gpio_dev->sim;
     int i;
-    u32 reg_val;
-    int handled = 0;
 
-    for (i = 0; i < NUM_GPIOS; i++) {
-        reg_val = gpio_read_reg(i);
-        
-        if (reg_val & GPIO_INT_STATUS_BIT) {
-            pr_info("GPIO%d: Interrupt detected (value=%d)\n", 
-                    i + 1, (reg_val & GPIO_DATA_BIT) ? 1 : 0);
-            
-            gpio_clear_int_status(i);
-            handled = 1;
-        }
-    }
+    for (i = 0; i < gpio_dev->ngpio; i++)
+        hrtimer_cancel(&gs->stim[i].timer);
 
-    return handled ? IRQ_HANDLED : IRQ_NONE;
+    static_branch_dec(&gpio_sim_active);
+#if IS_ENABLED(CONFIG_IRQ_SIM)
+    if (gs->irq > 0)
+        irq_dispose_mapping(gs->irq);
+    if (gs->domain)
+        irq_domain_remove_sim(gs->domain);
+#endif
+    kfree(gs);
+    gpio_dev->sim = NULL;
 }
 
-static int gpio_open(struct inode *inode, struct file *filp)
+/* Map the register bank, or set up the simulated one */
+static int gpio_map_registers(struct gpio_device *gpio_dev)
 {
-    pr_debug("GPIO device opened\n");
+    struct resource *mem = gpio_dev->mem;
+
+    if (sim)
+        return gpio_sim_init(gpio_dev);
+
+    /* The region is claimed by another driver on the target, map it as is */
+    gpio_dev->base_addr = ioremap(mem->start, resource_size(mem));
+    if (!gpio_dev->base_addr) {
+        pr_err("GPIO Driver: Failed to map memory\n");
+        return -ENOMEM;
+    }
+
     return 0;
 }
 
-static int gpio_release(struct inode *inode, struct file *filp)
+static void gpio_unmap_registers(struct gpio_device *gpio_dev)
 {
-    pr_debug("GPIO device closed\n");
-    return 0;
+    if (gpio_dev->sim) {
+        gpio_sim_exit(gpio_dev);
+        return;
+    }
+
+    iounmap(gpio_dev->base_addr);
 }
 
-static long gpio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+/*
+ * Pin count and register offsets: the default 8-pin layout, or one pin
+ * per entry of the node's "reg-offsets" property.
+ */
+static int gpio_bank_layout(struct gpio_device *gpio_dev, struct platform_device *pdev)
 {
-    struct gpio_config config;
-    int ret = 0;
+    struct device_node *np = pdev->dev.of_node;
+    int i, n;
 
-    switch (cmd) {
-    case GPIO_SET_DIRECTION:
-        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
-                          sizeof(config)))
-            return -EFAULT;
-        ret = gpio_set_direction(config.gpio_num, config.value);
-        break;
+    gpio_dev->ngpio = NUM_GPIOS;
+    memcpy(gpio_dev->offsets, gpio_default_offsets, sizeof(gpio_default_offsets));
 
-    case GPIO_READ_PIN:
-        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
-                          sizeof(config)))
-            return -EFAULT;
-        ret = gpio_read_pin(config.gpio_num, &config.value);
-        if (ret == 0) {
-            if (copy_to_user((struct gpio_config __user *)arg, &config, 
-                            sizeof(config)))
-                return -EFAULT;
-        }
-        break;
+    if (!sim) {
+        gpio_dev->mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
+        if (!gpio_dev->mem)
+            return -EINVAL;
+    }
 
-    case GPIO_WRITE_PIN:
-        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
-                          sizeof(config)))
-            return -EFAULT;
-        ret = gpio_write_pin(config.gpio_num, config.value);
-        break;
+    if (np && of_property_present(np, "reg-offsets")) {
+        n = of_property_count_u32_elems(np, "reg-offsets");
+        if (n < 1 || n > GPIO_MAX_PINS)
+            return -EINVAL;
+        if (of_property_read_u32_array(np, "reg-offsets", gpio_dev->offsets, n))
+            return -EINVAL;
+        gpio_dev->ngpio = n;
+    }
 
-    case GPIO_SET_INTERRUPT:
-        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
-                          sizeof(config)))
-            return -EFAULT;
-        ret = gpio_set_interrupt(config.gpio_num, config.value);
-        break;
+    /* Every register has to lie inside the bank's memory resource */
+    for (i = 0; gpio_dev->mem && i < gpio_dev->ngpio; i++) {
+        if (gpio_dev->offsets[i] + sizeof(u32) > resource_size(gpio_dev->mem))
+            return -EINVAL;
+    }
+    return 0;
+}
 
-    case GPIO_READ_INT_STATUS:
-        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
-                          sizeof(config)))
-            return -EFAULT;
-        ret = gpio_read_int_status(config.gpio_num, &config.value);
-        if (ret == 0) {
-            if (copy_to_user((struct gpio_config __user *)arg, &config, 
-                            sizeof(config)))
-                return -EFAULT;
-        }
-        break;
+static void gpio_debugfs_init(struct gpio_device *gpio_dev)
+{
+    char name[16];
 
-    case GPIO_CLEAR_INT_STATUS:
-        if (copy_from_user(&config, (struct gpio_config __user *)arg, 
-                          sizeof(config)))
-            return -EFAULT;
-        ret = gpio_clear_int_status(config.gpio_num);
-        break;
+    snprintf(name, sizeof(name), "bank%d", gpio_dev->id);
+    gpio_dev->debugfs = debugfs_create_dir(name, gpio_debugfs_root);
+    debugfs_create_file("stats", 0444, gpio_dev->debugfs, gpio_dev, &gpio_stats_fops);
+    debugfs_create_file("latency_hist", 0600, gpio_dev->debugfs, gpio_dev, 
+                        &gpio_hist_fops);
 
-    default:
-        return -ENOTTY;
+    if (gpio_dev->sim) {
+        debugfs_create_file("sim_inputs", 0600, gpio_dev->debugfs, gpio_dev, 
+                            &gpio_sim_inputs_fops);
+        debugfs_create_file("sim_stimulus", 0600, gpio_dev->debugfs, gpio_dev, 
+                            &gpio_sim_stim_fops);
     }
-
-    return ret;
 }
 
-static const struct file_operations gpio_fops = {
-    .owner = THIS_MODULE,
-    .open = gpio_open,
-    .release = gpio_release,
-    .unlocked_ioctl = gpio_ioctl,
-};
-
-/* Module initialization */
-static int __init gpio_driver_init(void)
+/* Bring up one bank */
+static int gpio_probe(struct platform_device *pdev)
 {
-    int ret;
+    struct gpio_device *gpio_dev;
     struct device *device;
-
-    pr_info("GPIO Driver: Initializing\n");
+    int ret, irq, i;
 
     /* Allocate device structure */
     gpio_dev = kzalloc(sizeof(struct gpio_device), GFP_KERNEL);
     if (!gpio_dev)
         return -ENOMEM;
 
-    /* Initialize spinlock */
+    gpio_dev->dev = &pdev->dev;
+    ret = gpio_bank_layout(gpio_dev, pdev);
+    if (ret) {
+        pr_err("GPIO Driver: %s: Invalid register layout\n", dev_name(&pdev->dev));
+        kfree(gpio_dev);
+        return ret;
+    }
+
+    /* Initialize spinlocks */
     spin_lock_init(&gpio_dev->lock);
+    for (i = 0; i < gpio_dev->ngpio; i++) {
+        spin_lock_init(&gpio_dev->pins[i].lock);
+        gpio_dev->pins[i].gpio_dev = gpio_dev;
+        gpio_dev->pins[i].edge = GPIO_EDGE_BOTH;
+        hrtimer_setup(&gpio_dev->pins[i].debounce_timer, gpio_debounce_timer, 
+                      CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+    }
 
-    /* Request memory region */
-    /* Map memory */
-    gpio_dev->base_addr = ioremap(GPIO_BASE_ADDR, GPIO_MEM_SIZE);
-    if (!gpio_dev->base_addr) {
-        pr_err("GPIO Driver: Failed to map memory\n");
-        ret = -ENOMEM;
-        goto err_ioremap;
+    /* Reflex rules, all slots free */
+    spin_lock_init(&gpio_dev->reflex_lock);
+    mutex_init(&gpio_dev->reflex_mutex);
+    for (i = 0; i < GPIO_REFLEX_MAX; i++) {
+        gpio_dev->reflex[i].gpio_dev = gpio_dev;
+        hrtimer_setup(&gpio_dev->reflex[i].timer, gpio_reflex_timer, 
+                      CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
     }
 
-    /* Allocate character device number */
-    ret = alloc_chrdev_region(&gpio_dev->devt, 0, 1, DRIVER_NAME);
-    if (ret < 0) {
-        pr_err("GPIO Driver: Failed to allocate device number\n");
-        goto err_alloc_chrdev;
+    /* Software PWM, all channels idle */
+    spin_lock_init(&gpio_dev->pwm_lock);
+    hrtimer_setup(&gpio_dev->pwm_timer, gpio_pwm_timer, CLOCK_MONOTONIC, 
+                  HRTIMER_MODE_ABS_HARD);
+
+    /* Paced output queue */
+    spin_lock_init(&gpio_dev->out_lock);
+    mutex_init(&gpio_dev->write_lock);
+    init_waitqueue_head(&gpio_dev->out_wait);
+    hrtimer_setup(&gpio_dev->out_timer, gpio_out_timer, CLOCK_MONOTONIC, 
+                  HRTIMER_MODE_ABS_HARD);
+
+    /* Logic analyzer, idle until GPIO_CAPTURE_START */
+    spin_lock_init(&gpio_dev->capture.lock);
+    mutex_init(&gpio_dev->capture.mutex);
+    hrtimer_setup(&gpio_dev->capture.timer, gpio_capture_timer, CLOCK_MONOTONIC, 
+                  HRTIMER_MODE_REL_HARD);
+
+    /* Sequencers, idle until a program is loaded */
+    mutex_init(&gpio_dev->seq_mutex);
+    for (i = 0; i < GPIO_SEQ_MAX; i++) {
+        struct gpio_seq *sq = &gpio_dev->seq[i];
+
+        sq->gpio_dev = gpio_dev;
+        spin_lock_init(&sq->lock);
+        INIT_KFIFO(sq->fifo);
+        hrtimer_setup(&sq->timer, gpio_seq_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+    }
+
+    /* Initialize event ring */
+    spin_lock_init(&gpio_dev->event_lock);
+    mutex_init(&gpio_dev->read_lock);
+    init_waitqueue_head(&gpio_dev->event_wait);
+    INIT_KFIFO(gpio_dev->irq_latches);
+    ret = gpio_event_ring_alloc(gpio_dev);
+    if (ret) {
+        pr_err("GPIO Driver: Failed to allocate event ring\n");
+        goto err_ring_alloc;
     }
 
+    /* Statistics counters */
+    BUILD_BUG_ON(GPIO_MAX_PINS > GPIO_STATS_NR_PINS);
+    BUILD_BUG_ON(GPIO_MAX_PINS > GPIO_COUNTER_NR_PINS);
+    gpio_dev->stats = alloc_percpu(struct gpio_stats);
+    gpio_dev->hist = alloc_percpu(struct gpio_latency_hist);
+    gpio_dev->out_buf = kvmalloc_array(GPIO_OUT_QUEUE_SIZE, 
+                                       sizeof(struct gpio_out_sample), GFP_KERNEL);
+    if (!gpio_dev->stats || !gpio_dev->hist || !gpio_dev->out_buf) {
+        ret = -ENOMEM;
+        goto err_free_stats;
+    }
+
+    /* Bank number, also the minor of /dev/simple_gpioN */
+    ret = ida_alloc_max(&gpio_ida, GPIO_MAX_BANKS - 1, GFP_KERNEL);
+    if (ret < 0)
+        goto err_free_stats;
+    gpio_dev->id = ret;
+    gpio_dev->devt = MKDEV(MAJOR(gpio_devt), gpio_dev->id);
+
+    /* Map registers */
+    ret = gpio_map_registers(gpio_dev);
+    if (ret)
+        goto err_map;
+
+    /* Start from whatever state the bootloader left behind */
+    __gpio_sync_shadow(gpio_dev);
+
     /* Initialize character device */
     cdev_init(&gpio_dev->cdev, &gpio_fops);
     gpio_dev->cdev.owner = THIS_MODULE;
@@ -325,30 +4254,31 @@ static int __init gpio_driver_init(void)
         goto err_cdev_add;
     }
 
-    /* Create device class */
-    gpio_dev->class = class_create(DRIVER_NAME);
-    if (IS_ERR(gpio_dev->class)) {
-        pr_err("GPIO Driver: Failed to create device class\n");
-        ret = PTR_ERR(gpio_dev->class);
-        goto err_class_create;
-    }
-
     /* Create device node */
-    device = device_create(gpio_dev->class, NULL, gpio_dev->devt, 
-                          NULL, DRIVER_NAME);
+    device = device_create(gpio_class, &pdev->dev, gpio_dev->devt, 
+                          gpio_dev, DRIVER_NAME "%d", gpio_dev->id);
     if (IS_ERR(device)) {
         pr_err("GPIO Driver: Failed to create device\n");
         ret = PTR_ERR(device);
         goto err_device_create;
     }
 
-    /* Register interrupt handler if IRQ number is provided */
-    if (gpio_irq >= 0) {
-        gpio_dev->irq = gpio_irq;
-        
-        ret = request_irq(gpio_dev->irq, gpio_irq_handler, 
-                         IRQF_SHARED | IRQF_TRIGGER_RISING, 
-                         DRIVER_NAME, gpio_dev);
+    irq = gpio_dev->sim ? gpio_dev->sim->irq : platform_get_irq_optional(pdev, 0);
+
+    ret = gpio_chip_register(gpio_dev, irq > 0);
+    if (ret) {
+        pr_err("GPIO Driver: Failed to register gpio_chip (error %d)\n", ret);
+        goto err_gpiochip;
+    }
+
+    /* Register interrupt handler if the bank has an IRQ */
+    if (irq > 0) {
+        gpio_dev->irq = irq;
+
+        ret = request_threaded_irq(gpio_dev->irq, gpio_irq_handler, 
+                                   gpio_irq_thread, 
+                                   IRQF_SHARED | IRQF_TRIGGER_RISING, 
+                                   dev_name(&pdev->dev), gpio_dev);
         if (ret) {
             pr_err("GPIO Driver: Failed to request IRQ %d (error %d)\n", 
                    gpio_dev->irq, ret);
@@ -357,39 +4287,54 @@ static int __init gpio_driver_init(void)
         } else {
             pr_info("GPIO Driver: IRQ %d registered successfully\n", 
                     gpio_dev->irq);
+
+            /* The IRQ thread follows the affinity of its interrupt */
+            if (irq_thread_cpu >= 0) {
+                if (irq_thread_cpu >= nr_cpu_ids || !cpu_online(irq_thread_cpu) || 
+                    irq_set_affinity(gpio_dev->irq, cpumask_of(irq_thread_cpu)))
+                    pr_warn("GPIO Driver: Cannot bind IRQ %d to CPU %d\n", 
+                            gpio_dev->irq, irq_thread_cpu);
+            }
         }
     } else {
         gpio_dev->irq = -1;
-        pr_info("GPIO Driver: No IRQ specified, running without interrupt support\n");
-        pr_info("GPIO Driver: Load with 'gpio_irq=<num>' parameter to enable interrupts\n");
+        pr_info("GPIO Driver: No IRQ for %s, running without interrupt support\n", 
+                dev_name(&pdev->dev));
     }
 
-    pr_info("GPIO Driver: Successfully initialized\n");
-    pr_info("GPIO Driver: Device created at /dev/%s\n", DRIVER_NAME);
-    pr_info("GPIO Driver: Major=%d, Minor=%d\n", 
-            MAJOR(gpio_dev->devt), MINOR(gpio_dev->devt));
+    gpio_debugfs_init(gpio_dev);
+    platform_set_drvdata(pdev, gpio_dev);
+
+    pr_info("GPIO Driver: Bank %d with %d pins at /dev/%s%d%s\n", gpio_dev->id, 
+            gpio_dev->ngpio, DRIVER_NAME, gpio_dev->id, 
+            gpio_dev->sim ? " (simulated registers)" : "");
 
     return 0;
 
+err_gpiochip:
+    device_destroy(gpio_class, gpio_dev->devt);
 err_device_create:
-    class_destroy(gpio_dev->class);
-err_class_create:
     cdev_del(&gpio_dev->cdev);
 err_cdev_add:
-    unregister_chrdev_region(gpio_dev->devt, 1);
-err_alloc_chrdev:
-    iounmap(gpio_dev->base_addr);
-err_ioremap:
-    release_mem_region(GPIO_BASE_ADDR, GPIO_MEM_SIZE);
-err_request_mem:
+    gpio_unmap_registers(gpio_dev);
+err_map:
+    ida_free(&gpio_ida, gpio_dev->id);
+err_free_stats:
+    kvfree(gpio_dev->out_buf);
+    free_percpu(gpio_dev->hist);
+    free_percpu(gpio_dev->stats);
+    vfree(gpio_dev->ring);
+err_ring_alloc:
     kfree(gpio_dev);
     return ret;
 }
 
-/* Module cleanup */
-static void __exit gpio_driver_exit(void)
+static void gpio_remove(struct platform_device *pdev)
 {
-    pr_info("GPIO Driver: Cleaning up\n");
+    struct gpio_device *gpio_dev = platform_get_drvdata(pdev);
+    int i;
+
+    debugfs_remove_recursive(gpio_dev->debugfs);
 
     /* Free IRQ if registered */
     if (gpio_dev->irq >= 0) {
@@ -397,26 +4342,177 @@ static void __exit gpio_driver_exit(void)
         pr_info("GPIO Driver: IRQ %d freed\n", gpio_dev->irq);
     }
 
-    /* Destroy device */
-    device_destroy(gpio_dev->class, gpio_dev->devt);
+    /* No IRQ left to re-arm them */
+    for (i = 0; i < gpio_dev->ngpio; i++)
+        hrtimer_cancel(&gpio_dev->pins[i].debounce_timer);
+    for (i = 0; i < GPIO_REFLEX_MAX; i++)
+        hrtimer_cancel(&gpio_dev->reflex[i].timer);
+    hrtimer_cancel(&gpio_dev->pwm_timer);
+    hrtimer_cancel(&gpio_dev->out_timer);
+    hrtimer_cancel(&gpio_dev->capture.timer);
+    for (i = 0; i < GPIO_SEQ_MAX; i++)
+        hrtimer_cancel(&gpio_dev->seq[i].timer);
+
+    gpiochip_remove(&gpio_dev->chip);
 
-    /* Destroy class */
-    class_destroy(gpio_dev->class);
+    /* Destroy device */
+    device_destroy(gpio_class, gpio_dev->devt);
 
     /* Remove character device */
     cdev_del(&gpio_dev->cdev);
 
-    /* Unregister device number */
-    unregister_chrdev_region(gpio_dev->devt, 1);
+    /* Unmap registers */
+    gpio_unmap_registers(gpio_dev);
+    ida_free(&gpio_ida, gpio_dev->id);
 
-    /* Unmap memory */
-    iounmap(gpio_dev->base_addr);
+    /* Free counters, buffers and device structure */
+    vfree(gpio_dev->capture.runs);
+    kvfree(gpio_dev->out_buf);
+    free_percpu(gpio_dev->hist);
+    free_percpu(gpio_dev->stats);
+    vfree(gpio_dev->ring);
+    kfree(gpio_dev);
+}
 
-    /* Release memory region */
-    release_mem_region(GPIO_BASE_ADDR, GPIO_MEM_SIZE);
+static const struct of_device_id gpio_of_match[] = {
+    { .compatible = "simple,gpio-bank" },
+    { }
+};
+MODULE_DEVICE_TABLE(of, gpio_of_match);
 
-    /* Free device structure */
-    kfree(gpio_dev);
+static struct platform_driver gpio_platform_driver = {
+    .probe = gpio_probe,
+    .remove = gpio_remove,
+    .driver = {
+        .name = DRIVER_NAME,
+        .of_match_table = gpio_of_match,
+        /*
+         * remove() frees the bank under any fd still open on it; the
+         * cdev's module reference keeps rmmod away, this keeps unbind away.
+         */
+        .suppress_bind_attrs = true,
+    },
+};
+
+static void gpio_unregister_param_banks(void)
+{
+    while (gpio_nr_param_pdevs > 0)
+        platform_device_unregister(gpio_param_pdevs[--gpio_nr_param_pdevs]);
+}
+
+/* Banks the device tree does not describe, from the module parameters */
+static int gpio_register_param_banks(void)
+{
+    struct platform_device *pdev;
+    struct device_node *np;
+    struct resource res[2];
+    int nbanks, nres, i;
+
+    if (sim) {
+        nbanks = sim_banks;
+    } else if (nr_bank_base) {
+        nbanks = nr_bank_base;
+    } else {
+        np = of_find_compatible_node(NULL, NULL, "simple,gpio-bank");
+        of_node_put(np);
+        if (np)
+            return 0;
+
+        /* Nothing configured: the single bank this driver always had */
+        bank_base[0] = GPIO_BASE_ADDR;
+        nbanks = 1;
+    }
+
+    if (gpio_irq >= 0 && !nr_bank_irq)
+        bank_irq[0] = gpio_irq;
+
+    for (i = 0; i < nbanks; i++) {
+        nres = 0;
+        if (!sim) {
+            res[nres++] = (struct resource)DEFINE_RES_MEM(bank_base[i], GPIO_MEM_SIZE);
+            if (bank_irq[i] >= 0)
+                res[nres++] = (struct resource)DEFINE_RES_IRQ(bank_irq[i]);
+        }
+
+        pdev = platform_device_register_simple(DRIVER_NAME, i, res, nres);
+        if (IS_ERR(pdev)) {
+            gpio_unregister_param_banks();
+            return PTR_ERR(pdev);
+        }
+        gpio_param_pdevs[gpio_nr_param_pdevs++] = pdev;
+    }
+
+    return 0;
+}
+
+/* Module initialization */
+static int __init gpio_driver_init(void)
+{
+    int ret;
+
+    pr_info("GPIO Driver: Initializing\n");
+
+    if (irq_thread_prio < 0 || irq_thread_prio >= MAX_RT_PRIO) {
+        pr_err("GPIO Driver: irq_thread_prio must be 0-%d\n", MAX_RT_PRIO - 1);
+        return -EINVAL;
+    }
+    if (sim && (sim_banks < 1 || sim_banks > GPIO_MAX_BANKS)) {
+        pr_err("GPIO Driver: sim_banks must be 1-%d\n", GPIO_MAX_BANKS);
+        return -EINVAL;
+    }
+
+    /* One minor per bank */
+    ret = alloc_chrdev_region(&gpio_devt, 0, GPIO_MAX_BANKS, DRIVER_NAME);
+    if (ret < 0) {
+        pr_err("GPIO Driver: Failed to allocate device numbers\n");
+        return ret;
+    }
+
+    /* Create device class */
+    gpio_class = class_create(DRIVER_NAME);
+    if (IS_ERR(gpio_class)) {
+        pr_err("GPIO Driver: Failed to create device class\n");
+        ret = PTR_ERR(gpio_class);
+        goto err_class_create;
+    }
+
+    gpio_debugfs_root = debugfs_create_dir(DRIVER_NAME, NULL);
+
+    ret = platform_driver_register(&gpio_platform_driver);
+    if (ret) {
+        pr_err("GPIO Driver: Failed to register platform driver\n");
+        goto err_driver_register;
+    }
+
+    ret = gpio_register_param_banks();
+    if (ret) {
+        pr_err("GPIO Driver: Failed to create banks (error %d)\n", ret);
+        goto err_param_banks;
+    }
+
+    pr_info("GPIO Driver: Successfully initialized, Major=%d\n", MAJOR(gpio_devt));
+    return 0;
+
+err_param_banks:
+    platform_driver_unregister(&gpio_platform_driver);
+err_driver_register:
+    debugfs_remove_recursive(gpio_debugfs_root);
+    class_destroy(gpio_class);
+err_class_create:
+    unregister_chrdev_region(gpio_devt, GPIO_MAX_BANKS);
+    return ret;
+}
+
+/* Module cleanup */
+static void __exit gpio_driver_exit(void)
+{
+    pr_info("GPIO Driver: Cleaning up\n");
+
+    gpio_unregister_param_banks();
+    platform_driver_unregister(&gpio_platform_driver);
+    debugfs_remove_recursive(gpio_debugfs_root);
+    class_destroy(gpio_class);
+    unregister_chrdev_region(gpio_devt, GPIO_MAX_BANKS);
 
     pr_info("GPIO Driver: Successfully removed\n");
 }
@@ -2,12 +2,457 @@
 #define GPIO_DRIVER_H
 
 #include <linux/ioctl.h>
+#include <linux/types.h>
 
 struct gpio_config {
     int gpio_num;  
     int value;     
 };
 
+/* One record of a GPIO_BATCH request */
+struct gpio_batch_op {
+    int op;        /* GPIO_OP_* */
+    int gpio_num;
+    int value;     /* argument, or result of a read op */
+    int result;    /* 0 or negative errno, filled in by the driver */
+};
+
+struct gpio_batch {
+    __u64 ops;     /* user pointer to struct gpio_batch_op[count] */
+    __u32 count;   /* at most GPIO_BATCH_MAX */
+    __u32 flags;   /* GPIO_BATCH_* */
+};
+
+/* Whole-bank snapshot, bit N describes GPIO N */
+struct gpio_bank_state {
+    __u32 data;
+    __u32 direction;
+    __u32 int_enable;
+    __u32 int_status;
+};
+
+/* Drive the output pins selected by mask to the matching bits of value */
+struct gpio_mask {
+    __u32 mask;
+    __u32 value;
+};
+
+/* One interrupt event, as returned by read() on the device */
+struct gpio_event {
+    __u64 timestamp_ns;   /* CLOCK_MONOTONIC */
+    __u64 seq;            /* increments per event, a gap means drops */
+    __u32 gpio_num;
+    __u32 value;          /* pin level sampled in the IRQ handler */
+};
+
+/*
+ * Shared event ring, mapped with mmap(fd, offset 0, MAP_SHARED).
+ *
+ * The header below sits at the start of the mapping and the records
+ * (struct gpio_event) start at data_offset. head and tail are
+ * free-running counters; a record lives in slot (index & (size - 1)),
+ * so the ring holds head - tail records.
+ *
+ * Memory ordering:
+ *  - The driver fills a record and then stores head with release
+ *    semantics. Load head with acquire semantics before reading the
+ *    records below it.
+ *  - When done with records, store the new tail with release
+ *    semantics; the driver may reuse those slots from then on.
+ *  - The ring is full when head - tail == size. Further events are
+ *    counted in dropped and their seq numbers are skipped.
+ *
+ * read() consumes from the same ring, so use one style of consumer
+ * per device.
+ */
+struct gpio_event_ring {
+    /* Fixed description, written once at load */
+    __u32 magic;          /* GPIO_EVENT_RING_MAGIC */
+    __u32 version;
+    __u32 size;           /* number of records, power of two */
+    __u32 record_size;    /* sizeof(struct gpio_event) */
+    __u32 data_offset;    /* byte offset of record 0 in the mapping */
+    __u32 reserved0[11];
+
+    /* Written by the driver only, own cache line */
+    __u32 head;
+    __u32 reserved1;
+    __u64 dropped;
+    __u64 produced;
+    __u32 reserved2[10];
+
+    /* Written by the consumer only, own cache line */
+    __u32 tail;
+    __u32 reserved3[15];
+};
+
+#define GPIO_EVENT_RING_MAGIC   0x47504952  /* "GPIR" */
+#define GPIO_EVENT_RING_VERSION 1
+
+struct gpio_event_stats {
+    __u64 produced;       /* events generated since load */
+    __u64 dropped;        /* events lost because the queue was full */
+    __u32 queued;         /* events waiting to be read */
+    __u32 capacity;
+};
+
+/*
+ * Hard-IRQ handler counters. Hit rate is pins_pending / pins_scanned,
+ * MMIO accesses per IRQ are (mmio_reads + mmio_writes) / irqs.
+ */
+struct gpio_irq_stats {
+    __u64 irqs;           /* handler invocations */
+    __u64 unhandled;      /* invocations with nothing pending */
+    __u64 pins_scanned;   /* interrupt-enabled pins visited */
+    __u64 pins_pending;   /* visited pins that had their status bit set */
+    __u64 mmio_reads;
+    __u64 mmio_writes;
+    __u64 edges_filtered; /* pending pins dropped by their GPIO_EDGE_* mode */
+    __u64 bounces_filtered; /* edges swallowed by GPIO_SET_DEBOUNCE windows */
+};
+
+/*
+ * Per-pin and per-command counters for GPIO_GET_STATS. The driver keeps
+ * them per CPU and only sums them on read, so a snapshot is not atomic.
+ */
+#define GPIO_STATS_NR_PINS 32
+#define GPIO_STATS_NR_CMDS 32  /* indexed by _IOC_NR() of the ioctl */
+
+struct gpio_pin_stats {
+    __u64 reads;
+    __u64 writes;
+    __u64 direction_changes;
+    __u64 irqs;           /* status bit seen set by the IRQ handler */
+    __u64 irqs_cleared;   /* status acknowledged, by the handler or by user */
+    __u64 eperm;          /* writes refused because the pin is an input */
+    __u64 einval;         /* edge/debounce settings rejected */
+};
+
+struct gpio_cmd_stats {
+    __u64 calls;
+    __u64 eperm;
+    __u64 einval;
+};
+
+/* Only __u64 members, the driver sums it across CPUs word by word */
+struct gpio_stats {
+    struct gpio_pin_stats pins[GPIO_STATS_NR_PINS];
+    struct gpio_cmd_stats cmds[GPIO_STATS_NR_CMDS];
+    __u64 lock_acquisitions;  /* multi-pin operations */
+    __u64 lock_hold_ns;       /* total time spent holding the device lock */
+};
+
+/*
+ * Reflex rule (GPIO_SET_REFLEX): when in_gpio sees an edge, the IRQ
+ * handler applies action to out_gpio, after delay_us if that is set.
+ * Setting a rule enables the interrupt of in_gpio; GPIO_REFLEX_OFF
+ * frees the slot. A rule that fires while its delay or pulse is still
+ * running counts as missed.
+ */
+#define GPIO_REFLEX_MAX     16      /* rule slots per bank */
+#define GPIO_REFLEX_MAX_US  1000000 /* upper bound of delay_us and pulse_us */
+
+struct gpio_reflex {
+    __u32 index;          /* slot, below GPIO_REFLEX_MAX */
+    __u32 in_gpio;
+    __u32 edge;           /* GPIO_EDGE_RISING, _FALLING or _BOTH */
+    __u32 out_gpio;       /* must be an output when the rule fires */
+    __u32 action;         /* GPIO_REFLEX_* */
+    __u32 pulse_us;       /* high time of GPIO_REFLEX_PULSE */
+    __u32 delay_us;       /* 0 acts from the IRQ handler itself */
+    __u32 reserved;
+};
+
+/* Latency runs from IRQ handler entry to the output write, minus delay_us */
+struct gpio_reflex_stats {
+    __u32 index;          /* in: slot to read */
+    __u32 reserved;
+    __u64 hits;           /* actions performed */
+    __u64 missed;         /* edges dropped: still busy, or out_gpio not an output */
+    __u64 latency_min_ns;
+    __u64 latency_max_ns;
+    __u64 latency_total_ns; /* average is latency_total_ns / hits */
+};
+
+/*
+ * Software PWM of an output pin (GPIO_SET_PWM). All channels of a bank
+ * share one hrtimer that wakes up at the next transition of any of them.
+ * period_ns 0 stops the channel and leaves the pin low; duty_ns 0 or
+ * duty_ns == period_ns hold the pin low or high without timer edges.
+ */
+#define GPIO_PWM_MIN_PERIOD_NS 10000
+
+struct gpio_pwm {
+    __u32 gpio_num;
+    __u32 reserved;
+    __u64 period_ns;
+    __u64 duty_ns;        /* high time, at most period_ns */
+};
+
+/* Requested against achieved timing of one channel (GPIO_GET_PWM_STATS) */
+struct gpio_pwm_stats {
+    __u32 gpio_num;       /* in: pin to read */
+    __u32 reserved;
+    __u64 period_ns;      /* requested */
+    __u64 duty_ns;
+    __u64 periods;        /* rising edges generated */
+    __u64 achieved_period_ns; /* mean time between rising edges */
+    __u64 achieved_duty_ns;   /* mean high time */
+    __u64 late_max_ns;    /* worst delay of a transition behind its schedule */
+    __u64 late_total_ns;  /* summed over all transitions */
+    __u64 skipped;        /* periods dropped because the timer fell behind */
+};
+
+/*
+ * Paced output: write() takes whole struct gpio_out_sample records and
+ * the driver clocks them out from an hrtimer. Each sample drives the
+ * output pins in mask to the matching bits of value, delta_ns after the
+ * previous sample (after the write for the first one). A full queue
+ * blocks the writer; poll() reports POLLOUT when there is room again.
+ */
+#define GPIO_OUT_QUEUE_SIZE 4096    /* samples, power of two */
+
+struct gpio_out_sample {
+    __u32 mask;           /* 0 makes the sample a pure delay */
+    __u32 value;
+    __u64 delta_ns;
+};
+
+/* GPIO_SET_OUT_MODE flags */
+#define GPIO_OUT_LOOP  (1 << 0)     /* replay the queue until flushed or cleared */
+#define GPIO_OUT_FLUSH (1 << 1)     /* stop and drop all samples, not sticky */
+
+struct gpio_out_stats {
+    __u64 played;         /* samples applied */
+    __u64 underruns;      /* queue ran dry while playing, the end of a stream too */
+    __u64 rejected;       /* samples whose mask held a pin that is not an output */
+    __u64 late_max_ns;    /* worst delay of a sample behind its schedule */
+    __u32 queued;
+    __u32 capacity;
+    __u32 flags;          /* GPIO_OUT_LOOP */
+    __u32 running;
+};
+
+/*
+ * Logic-analyzer capture (GPIO_CAPTURE_START). Every period_ns an hrtimer
+ * takes a coherent snapshot of the data bit of all pins (bit N for GPIO
+ * N). Consecutive equal snapshots are stored as one run. While armed only
+ * the latest pre_samples are kept; the first snapshot with
+ * (value & trig_mask) == trig_value is the trigger, and capture ends
+ * post_samples later, or earlier when the buffer fills up.
+ *
+ * The runs are read with mmap(fd, offset GPIO_CAPTURE_MMAP_OFFSET). The
+ * buffer is circular: GPIO_CAPTURE_STATUS gives the valid window as
+ * nr_runs entries starting at first_run, wrapping at capacity. Read it
+ * once the state is GPIO_CAPTURE_DONE.
+ */
+#define GPIO_CAPTURE_RUNS           65536       /* buffer size in runs */
+#define GPIO_CAPTURE_MIN_PERIOD_NS  5000
+#define GPIO_CAPTURE_MMAP_OFFSET    0x100000    /* the event ring is at 0 */
+
+struct gpio_capture_run {
+    __u32 value;          /* data bits of the bank */
+    __u32 count;          /* consecutive samples with that value */
+};
+
+struct gpio_capture_config {
+    __u64 period_ns;
+    __u32 trig_mask;      /* 0 triggers on the first sample */
+    __u32 trig_value;
+    __u32 pre_samples;
+    __u32 post_samples;
+};
+
+#define GPIO_CAPTURE_IDLE      0
+#define GPIO_CAPTURE_ARMED     1
+#define GPIO_CAPTURE_TRIGGERED 2
+#define GPIO_CAPTURE_DONE      3
+
+struct gpio_capture_status {
+    __u32 state;          /* GPIO_CAPTURE_* */
+    __u32 capacity;       /* runs, GPIO_CAPTURE_RUNS */
+    __u32 first_run;
+    __u32 nr_runs;
+    __u64 samples;        /* samples covered by the valid runs */
+    __u64 trigger_sample; /* index of the trigger within those samples */
+    __u64 start_ns;       /* CLOCK_MONOTONIC time of the first sample */
+    __u64 late_ticks;     /* samples the timer missed; the run was extended */
+    __u32 truncated;      /* the buffer filled before post_samples were taken */
+    __u32 reserved;
+};
+
+/*
+ * Bit-banged bus transfer (GPIO_XFER), run entirely in the driver. The
+ * pins of the bus are locked with interrupts off for one SPI or I2C bit,
+ * or one UART frame, at a time; edges are timed by busy-waiting,
+ * period_ns per clock (or per bit for UART). Pins with a PWM or an
+ * in-kernel IRQ consumer are refused.
+ *
+ * SPI:  pins = SCK, MOSI, MISO, CS. Full duplex for tx_len bytes, rx_buf
+ *       may be 0. CS is active low; MISO and CS may be GPIO_XFER_NO_PIN.
+ * I2C:  pins = SDA, SCL, driven open drain (external pull-ups needed).
+ *       Writes tx_len bytes to addr, then reads rx_len bytes after a
+ *       repeated start. A missing ACK ends the transfer with -ENXIO on
+ *       the address, -EIO on data. A slave may stretch each clock by up
+ *       to GPIO_XFER_MAX_STRETCH_NS, longer fails with -ETIMEDOUT.
+ * UART: pins = TX, RX, 8N1, LSB first. Sends tx_len bytes, then receives
+ *       rx_len bytes, waiting up to timeout_us for each start bit. The
+ *       pin of an unused direction may be GPIO_XFER_NO_PIN.
+ */
+#define GPIO_XFER_SPI  1
+#define GPIO_XFER_I2C  2
+#define GPIO_XFER_UART 3
+
+#define GPIO_XFER_CPOL      (1 << 0)    /* SPI: clock idles high */
+#define GPIO_XFER_CPHA      (1 << 1)    /* SPI: sample on the trailing edge */
+#define GPIO_XFER_LSB_FIRST (1 << 2)    /* SPI */
+
+#define GPIO_XFER_NO_PIN             0xff
+#define GPIO_XFER_MAX                4096     /* bytes per direction */
+#define GPIO_XFER_MIN_PERIOD_NS      200
+#define GPIO_XFER_MAX_PERIOD_NS      20000    /* bounds the irqs-off time per bit */
+#define GPIO_XFER_UART_MAX_PERIOD_NS 9000     /* 115200 baud up, under 100 us per frame */
+#define GPIO_XFER_MAX_TIMEOUT_US     1000000
+#define GPIO_XFER_MAX_STRETCH_NS     10000    /* I2C, per clock, irqs off */
+
+struct gpio_xfer {
+    __u32 protocol;       /* GPIO_XFER_SPI, _I2C or _UART */
+    __u32 flags;          /* GPIO_XFER_CPOL, _CPHA, _LSB_FIRST */
+    __u8 pins[4];
+    __u32 period_ns;
+    __u32 addr;           /* I2C 7-bit address */
+    __u32 timeout_us;     /* UART receive */
+    __u32 tx_len;
+    __u32 rx_len;         /* unused for SPI, rx is tx_len long */
+    __u64 tx_buf;         /* user pointers */
+    __u64 rx_buf;
+    /* Filled in by the driver, also when the transfer fails */
+    __u32 tx_done;        /* bytes */
+    __u32 rx_done;
+    __u64 duration_ns;    /* first edge to last edge */
+    __u64 bit_rate;       /* payload bits per second over duration_ns */
+};
+
+/*
+ * Pin sequencer (GPIO_SEQ_LOAD_PROG): small programs run by a hard hrtimer,
+ * up to GPIO_SEQ_MAX per bank. Every period_ns the machine executes at
+ * most steps_per_tick instructions with the locks of its pins held, and
+ * ends the tick early on WAIT, DELAY or a PUSH to a full FIFO. Programs
+ * are checked when loaded; an instruction that cannot run (SET or TOGGLE
+ * of a pin that is not an output) stops the machine in GPIO_SEQ_FAULT
+ * with pc on it. Running off the end is the same as END.
+ *
+ *   END                      stop, state GPIO_SEQ_DONE
+ *   SET     pin, arg         drive the output to arg (0 or 1)
+ *   TOGGLE  pin
+ *   WAIT    pin, arg         stall until the pin reads arg (0 or 1)
+ *   DELAY   arg              run the next instruction arg ticks later
+ *   IN      pin              isr = isr << 1 | level
+ *   PUSH    arg              isr to the FIFO and clear it; a full FIFO
+ *                            stalls, or with arg GPIO_SEQ_PUSH_DROP
+ *                            drops the value and counts an overflow
+ *   LOAD    arg              x = arg
+ *   JMP     cond, pin, arg   jump to instruction arg if cond holds
+ */
+#define GPIO_SEQ_MAX            4
+#define GPIO_SEQ_MAX_INSNS      64
+#define GPIO_SEQ_MAX_STEPS      64      /* bound of steps_per_tick */
+#define GPIO_SEQ_FIFO_SIZE      32      /* words, a power of two */
+#define GPIO_SEQ_MIN_PERIOD_NS  5000
+
+#define GPIO_SEQ_END     0
+#define GPIO_SEQ_SET     1
+#define GPIO_SEQ_TOGGLE  2
+#define GPIO_SEQ_WAIT    3
+#define GPIO_SEQ_DELAY   4
+#define GPIO_SEQ_IN      5
+#define GPIO_SEQ_PUSH    6
+#define GPIO_SEQ_LOAD    7
+#define GPIO_SEQ_JMP     8
+
+#define GPIO_SEQ_ALWAYS   0
+#define GPIO_SEQ_X_DEC    1     /* x != 0, and decrement it */
+#define GPIO_SEQ_PIN_HIGH 2
+#define GPIO_SEQ_PIN_LOW  3
+
+#define GPIO_SEQ_PUSH_DROP 1
+
+struct gpio_seq_insn {
+    __u8 op;              /* GPIO_SEQ_END ... GPIO_SEQ_JMP */
+    __u8 pin;
+    __u8 cond;            /* JMP only */
+    __u8 reserved;
+    __u32 arg;
+};
+
+struct gpio_seq_program {
+    __u32 index;          /* state machine, < GPIO_SEQ_MAX */
+    __u32 ninsns;         /* 0 stops the machine */
+    __u32 steps_per_tick;
+    __u32 reserved;
+    __u64 period_ns;
+    __u64 insns;          /* user pointer to ninsns instructions */
+};
+
+#define GPIO_SEQ_IDLE    0
+#define GPIO_SEQ_RUNNING 1
+#define GPIO_SEQ_DONE    2
+#define GPIO_SEQ_FAULT   3
+
+struct gpio_seq_status {
+    __u32 index;          /* in */
+    __u32 state;          /* GPIO_SEQ_* */
+    __u32 pc;
+    __u32 x;
+    __u32 isr;
+    __u32 fifo_level;
+    __u64 ticks;
+    __u64 steps;          /* instructions executed */
+    __u64 stall_ticks;    /* ticks spent in WAIT, DELAY or a blocked PUSH */
+    __u64 budget_ticks;   /* ticks that ran out of steps_per_tick */
+    __u64 late_ticks;     /* periods the timer missed */
+    __u64 fifo_overflows;
+};
+
+struct gpio_seq_fifo {
+    __u32 index;          /* in */
+    __u32 count;          /* out: words in values */
+    __u32 values[GPIO_SEQ_FIFO_SIZE];
+};
+
+/*
+ * Edge counting (GPIO_SET_COUNTER, value 1 on, 0 off). The hard-IRQ
+ * handler counts and times every edge of the pin instead of queueing
+ * events; a debounced pin is counted on its settled edges. Pulse width
+ * is rise to fall, period rise to rise. An interrupt that finds the
+ * level unchanged means a whole pulse went by between two interrupts:
+ * both edges are counted, missed goes up and timing restarts at the
+ * next rise. Switching counting on clears the pin's counters and
+ * enables its interrupt; switching it off leaves the interrupt enabled.
+ */
+#define GPIO_COUNTER_NR_PINS 32
+
+struct gpio_counter {
+    __u64 rising;
+    __u64 falling;
+    __u64 missed;
+    __u64 last_edge_ns;   /* CLOCK_MONOTONIC */
+    __u64 widths;         /* pulses measured */
+    __u64 width_min_ns;
+    __u64 width_max_ns;
+    __u64 width_avg_ns;
+    __u64 periods;        /* periods measured */
+    __u64 period_min_ns;
+    __u64 period_max_ns;
+    __u64 period_avg_ns;
+};
+
+struct gpio_counters {
+    __u32 mask;           /* pins in counting mode, bit N for GPIO N */
+    __u32 reserved;
+    struct gpio_counter pins[GPIO_COUNTER_NR_PINS];
+};
+
 #define GPIO_IOC_MAGIC 'g'
 
 #define GPIO_SET_DIRECTION    _IOW(GPIO_IOC_MAGIC, 1, struct gpio_config)
@@ -16,6 +461,30 @@ struct gpio_config {
 #define GPIO_SET_INTERRUPT    _IOW(GPIO_IOC_MAGIC, 4, struct gpio_config)
 #define GPIO_READ_INT_STATUS  _IOWR(GPIO_IOC_MAGIC, 5, struct gpio_config)
 #define GPIO_CLEAR_INT_STATUS _IOW(GPIO_IOC_MAGIC, 6, struct gpio_config)
+#define GPIO_BATCH            _IOWR(GPIO_IOC_MAGIC, 7, struct gpio_batch)
+#define GPIO_READ_ALL         _IOR(GPIO_IOC_MAGIC, 8, struct gpio_bank_state)
+#define GPIO_WRITE_MASK       _IOW(GPIO_IOC_MAGIC, 9, struct gpio_mask)
+#define GPIO_SYNC_SHADOW      _IO(GPIO_IOC_MAGIC, 10)
+#define GPIO_GET_EVENT_STATS  _IOR(GPIO_IOC_MAGIC, 11, struct gpio_event_stats)
+#define GPIO_GET_IRQ_STATS    _IOR(GPIO_IOC_MAGIC, 12, struct gpio_irq_stats)
+#define GPIO_SET_EDGE         _IOW(GPIO_IOC_MAGIC, 13, struct gpio_config)
+#define GPIO_SET_DEBOUNCE     _IOW(GPIO_IOC_MAGIC, 14, struct gpio_config)
+#define GPIO_GET_STATS        _IOR(GPIO_IOC_MAGIC, 15, struct gpio_stats)
+#define GPIO_SET_REFLEX       _IOW(GPIO_IOC_MAGIC, 16, struct gpio_reflex)
+#define GPIO_GET_REFLEX_STATS _IOWR(GPIO_IOC_MAGIC, 17, struct gpio_reflex_stats)
+#define GPIO_SET_PWM          _IOW(GPIO_IOC_MAGIC, 18, struct gpio_pwm)
+#define GPIO_GET_PWM_STATS    _IOWR(GPIO_IOC_MAGIC, 19, struct gpio_pwm_stats)
+#define GPIO_SET_OUT_MODE     _IOW(GPIO_IOC_MAGIC, 20, __u32)
+#define GPIO_GET_OUT_STATS    _IOR(GPIO_IOC_MAGIC, 21, struct gpio_out_stats)
+#define GPIO_CAPTURE_START    _IOW(GPIO_IOC_MAGIC, 22, struct gpio_capture_config)
+#define GPIO_CAPTURE_STOP     _IO(GPIO_IOC_MAGIC, 23)
+#define GPIO_CAPTURE_STATUS   _IOR(GPIO_IOC_MAGIC, 24, struct gpio_capture_status)
+#define GPIO_XFER             _IOWR(GPIO_IOC_MAGIC, 25, struct gpio_xfer)
+#define GPIO_SEQ_LOAD_PROG    _IOW(GPIO_IOC_MAGIC, 26, struct gpio_seq_program)
+#define GPIO_SEQ_GET_STATUS   _IOWR(GPIO_IOC_MAGIC, 27, struct gpio_seq_status)
+#define GPIO_SEQ_POP          _IOWR(GPIO_IOC_MAGIC, 28, struct gpio_seq_fifo)
+#define GPIO_SET_COUNTER      _IOW(GPIO_IOC_MAGIC, 29, struct gpio_config)
+#define GPIO_GET_COUNTERS     _IOR(GPIO_IOC_MAGIC, 30, struct gpio_counters)
 
 #define GPIO_DIR_INPUT  0
 #define GPIO_DIR_OUTPUT 1
@@ -23,4 +492,35 @@ struct gpio_config {
 #define GPIO_INT_DISABLE 0
 #define GPIO_INT_ENABLE  1
 
+/* Which interrupts of a pin are reported (GPIO_SET_EDGE), default BOTH */
+#define GPIO_EDGE_RISING     1
+#define GPIO_EDGE_FALLING    2
+#define GPIO_EDGE_BOTH       3
+#define GPIO_EDGE_LEVEL_HIGH 4
+#define GPIO_EDGE_LEVEL_LOW  8
+
+/* GPIO_SET_DEBOUNCE value is in microseconds, 0 turns debouncing off */
+#define GPIO_DEBOUNCE_MAX_US 1000000
+
+/* Reflex actions */
+#define GPIO_REFLEX_OFF    0
+#define GPIO_REFLEX_SET    1
+#define GPIO_REFLEX_CLEAR  2
+#define GPIO_REFLEX_TOGGLE 3
+#define GPIO_REFLEX_PULSE  4
+
+/* Batch op codes, same meaning as the single-pin ioctls */
+#define GPIO_OP_SET_DIRECTION    1
+#define GPIO_OP_READ_PIN         2
+#define GPIO_OP_WRITE_PIN        3
+#define GPIO_OP_SET_INTERRUPT    4
+#define GPIO_OP_READ_INT_STATUS  5
+#define GPIO_OP_CLEAR_INT_STATUS 6
+#define GPIO_OP_SET_EDGE         7
+
+#define GPIO_BATCH_MAX 64
+
+/* Stop at the first failing op, later records get -ECANCELED */
+#define GPIO_BATCH_STOP_ON_ERROR (1 << 0)
+
 #endif 
@@ -10,9 +10,11 @@
 #include <sys/ioctl.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include "gpio_driver.h"
 
-#define DEVICE_PATH "/dev/simple_gpio"
+#define DEVICE_PATH "/dev/simple_gpio0"
 
 /* Function prototypes */
 void print_usage(const char *prog_name);
@@ -20,8 +22,31 @@ int set_gpio_direction(int fd, int gpio_num, int direction);
 int read_gpio_pin(int fd, int gpio_num);
 int write_gpio_pin(int fd, int gpio_num, int value);
 int set_gpio_interrupt(int fd, int gpio_num, int enable);
+int set_gpio_edge(int fd, int gpio_num, int edge);
+int set_gpio_debounce(int fd, int gpio_num, int debounce_us);
 int read_gpio_interrupt_status(int fd, int gpio_num);
 int clear_gpio_interrupt_status(int fd, int gpio_num);
+int run_gpio_batch(int fd, struct gpio_batch_op *ops, unsigned int count);
+int read_gpio_all(int fd);
+int write_gpio_mask(int fd, unsigned int mask, unsigned int value);
+int monitor_gpio_events(int fd, int max_events);
+int monitor_gpio_events_mmap(int fd, int max_events);
+int show_gpio_irq_stats(int fd);
+int show_gpio_stats(int fd);
+int set_gpio_reflex(int fd, struct gpio_reflex *rx);
+int show_gpio_reflex_stats(int fd, unsigned int index);
+int set_gpio_pwm(int fd, int gpio_num, unsigned long long period_ns, 
+                 unsigned long long duty_ns);
+int show_gpio_pwm_stats(int fd, int gpio_num);
+int play_gpio_square(int fd, unsigned int mask, unsigned long long delta_ns, int count);
+int set_gpio_out_mode(int fd, unsigned int mode);
+int show_gpio_out_stats(int fd);
+int run_gpio_capture(int fd, struct gpio_capture_config *cfg);
+int run_gpio_spi(int fd, struct gpio_xfer *xfer, int nbytes, char **bytes);
+int run_gpio_seq_sample(int fd, int gpio_num, unsigned long long period_ns, int words);
+int show_gpio_seq_status(int fd, unsigned int index);
+int set_gpio_counter(int fd, int gpio_num, int enable);
+int show_gpio_counters(int fd);
 void demo_all_functions(int fd);
 
 int main(int argc, char *argv[])
@@ -46,6 +71,20 @@ int main(int argc, char *argv[])
     if (argc == 1) {
         /* No arguments, run demo */
         demo_all_functions(fd);
+    } else if (argc == 2 && strcmp(argv[1], "read_all") == 0) {
+        read_gpio_all(fd);
+    } else if (argc == 2 && strcmp(argv[1], "irq_stats") == 0) {
+        show_gpio_irq_stats(fd);
+    } else if (argc == 2 && strcmp(argv[1], "stats") == 0) {
+        show_gpio_stats(fd);
+    } else if (argc == 2 && strcmp(argv[1], "out_stats") == 0) {
+        show_gpio_out_stats(fd);
+    } else if (argc == 2 && strcmp(argv[1], "counters") == 0) {
+        show_gpio_counters(fd);
+    } else if (argc >= 2 && argc <= 3 && strcmp(argv[1], "monitor") == 0) {
+        monitor_gpio_events(fd, argc == 3 ? atoi(argv[2]) : 0);
+    } else if (argc >= 2 && argc <= 3 && strcmp(argv[1], "monitor_mmap") == 0) {
+        monitor_gpio_events_mmap(fd, argc == 3 ? atoi(argv[2]) : 0);
     } else if (argc >= 3) {
         /* Command line operation */
         if (strcmp(argv[1], "set_dir") == 0 && argc == 4) {
@@ -63,12 +102,69 @@ int main(int argc, char *argv[])
             gpio_num = atoi(argv[2]);
             value = atoi(argv[3]);
             set_gpio_interrupt(fd, gpio_num, value);
+        } else if (strcmp(argv[1], "set_edge") == 0 && argc == 4) {
+            gpio_num = atoi(argv[2]);
+            value = atoi(argv[3]);
+            set_gpio_edge(fd, gpio_num, value);
+        } else if (strcmp(argv[1], "debounce") == 0 && argc == 4) {
+            gpio_num = atoi(argv[2]);
+            value = atoi(argv[3]);
+            set_gpio_debounce(fd, gpio_num, value);
         } else if (strcmp(argv[1], "read_int") == 0 && argc == 3) {
             gpio_num = atoi(argv[2]);
             read_gpio_interrupt_status(fd, gpio_num);
         } else if (strcmp(argv[1], "clear_int") == 0 && argc == 3) {
             gpio_num = atoi(argv[2]);
             clear_gpio_interrupt_status(fd, gpio_num);
+        } else if (strcmp(argv[1], "reflex") == 0 && argc >= 7 && argc <= 9) {
+            struct gpio_reflex rx = {
+                .index = strtoul(argv[2], NULL, 0),
+                .in_gpio = strtoul(argv[3], NULL, 0),
+                .edge = strtoul(argv[4], NULL, 0),
+                .out_gpio = strtoul(argv[5], NULL, 0),
+                .action = strtoul(argv[6], NULL, 0),
+                .pulse_us = argc >= 8 ? strtoul(argv[7], NULL, 0) : 0,
+                .delay_us = argc >= 9 ? strtoul(argv[8], NULL, 0) : 0,
+            };
+            set_gpio_reflex(fd, &rx);
+        } else if (strcmp(argv[1], "reflex_stats") == 0 && argc == 3) {
+            show_gpio_reflex_stats(fd, strtoul(argv[2], NULL, 0));
+        } else if (strcmp(argv[1], "pwm") == 0 && argc == 5) {
+            set_gpio_pwm(fd, atoi(argv[2]), strtoull(argv[3], NULL, 0), 
+                         strtoull(argv[4], NULL, 0));
+        } else if (strcmp(argv[1], "pwm_stats") == 0 && argc == 3) {
+            show_gpio_pwm_stats(fd, atoi(argv[2]));
+        } else if (strcmp(argv[1], "play") == 0 && argc == 5) {
+            play_gpio_square(fd, strtoul(argv[2], NULL, 0), 
+                             strtoull(argv[3], NULL, 0), atoi(argv[4]));
+        } else if (strcmp(argv[1], "out_mode") == 0 && argc == 3) {
+            set_gpio_out_mode(fd, strtoul(argv[2], NULL, 0));
+        } else if (strcmp(argv[1], "capture") == 0 && argc == 7) {
+            struct gpio_capture_config cfg = {
+                .period_ns = strtoull(argv[2], NULL, 0),
+                .trig_mask = strtoul(argv[3], NULL, 0),
+                .trig_value = strtoul(argv[4], NULL, 0),
+                .pre_samples = strtoul(argv[5], NULL, 0),
+                .post_samples = strtoul(argv[6], NULL, 0),
+            };
+            run_gpio_capture(fd, &cfg);
+        } else if (strcmp(argv[1], "spi") == 0 && argc >= 8 && argc - 7 <= 64) {
+            struct gpio_xfer xfer = {
+                .protocol = GPIO_XFER_SPI,
+                .pins = { atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), atoi(argv[5]) },
+                .period_ns = strtoul(argv[6], NULL, 0),
+            };
+            run_gpio_spi(fd, &xfer, argc - 7, &argv[7]);
+        } else if (strcmp(argv[1], "seq_sample") == 0 && argc == 5) {
+            run_gpio_seq_sample(fd, atoi(argv[2]), strtoull(argv[3], NULL, 0), 
+                                atoi(argv[4]));
+        } else if (strcmp(argv[1], "count") == 0 && argc == 4) {
+            set_gpio_counter(fd, atoi(argv[2]), atoi(argv[3]));
+        } else if (strcmp(argv[1], "seq_status") == 0 && argc == 3) {
+            show_gpio_seq_status(fd, strtoul(argv[2], NULL, 0));
+        } else if (strcmp(argv[1], "write_mask") == 0 && argc == 4) {
+            write_gpio_mask(fd, strtoul(argv[2], NULL, 0), 
+                            strtoul(argv[3], NULL, 0));
         } else {
             print_usage(argv[0]);
         }
@@ -93,11 +189,59 @@ void print_usage(const char *prog_name)
            prog_name);
     printf("  %s set_int <gpio> <enable>      - Set interrupt (0=off, 1=on)\n", 
            prog_name);
+    printf("  %s set_edge <gpio> <edge>       - Set edge (1=rise, 2=fall, 3=both, 4=high, 8=low)\n", 
+           prog_name);
+    printf("  %s debounce <gpio> <usec>       - Set debounce time (0=off)\n", 
+           prog_name);
     printf("  %s read_int <gpio>              - Read interrupt status\n", 
            prog_name);
     printf("  %s clear_int <gpio>             - Clear interrupt status\n", 
            prog_name);
-    printf("\nGPIO numbers: 0-7 (corresponding to GPIO pins 1-8)\n");
+    printf("  %s read_all                     - Read the whole bank\n", 
+           prog_name);
+    printf("  %s write_mask <mask> <value>    - Write masked output pins\n", 
+           prog_name);
+    printf("  %s monitor [count]              - Wait for interrupt events\n", 
+           prog_name);
+    printf("  %s irq_stats                    - Show IRQ handler counters\n", 
+           prog_name);
+    printf("  %s stats                        - Show per-pin and lock counters\n", 
+           prog_name);
+    printf("  %s monitor_mmap [count]         - Same, zero-copy via mmap\n", 
+           prog_name);
+    printf("  %s reflex <slot> <in> <edge> <out> <action> [pulse_us] [delay_us]\n"
+           "      - Kernel-side rule: on edge (1=rise, 2=fall, 3=both) of in, act on out\n"
+           "        (0=off, 1=set, 2=clear, 3=toggle, 4=pulse)\n", 
+           prog_name);
+    printf("  %s reflex_stats <slot>          - Show hits and latency of a rule\n", 
+           prog_name);
+    printf("  %s pwm <gpio> <period_ns> <duty_ns> - Kernel PWM on an output (period 0=off)\n", 
+           prog_name);
+    printf("  %s pwm_stats <gpio>             - Requested vs achieved PWM timing\n", 
+           prog_name);
+    printf("  %s play <mask> <delta_ns> <count> - Queue a square wave on the masked outputs\n", 
+           prog_name);
+    printf("  %s out_mode <flags>             - Paced output mode (1=loop, 2=flush)\n", 
+           prog_name);
+    printf("  %s out_stats                    - Show paced output counters\n", 
+           prog_name);
+    printf("  %s capture <period_ns> <trig_mask> <trig_value> <pre> <post>\n"
+           "      - Sample the bank until the trigger plus post samples, print the runs\n", 
+           prog_name);
+    printf("  %s spi <sck> <mosi> <miso> <cs> <period_ns> <byte>...\n"
+           "      - Bit-banged SPI mode 0 transfer in the driver (pin 255=none)\n", 
+           prog_name);
+    printf("  %s seq_sample <gpio> <period_ns> <words> - Sequencer 0 shifts in a pin, 8 bits per word\n", 
+           prog_name);
+    printf("  %s seq_status <index>           - Show a sequencer's state and counters\n", 
+           prog_name);
+    printf("  %s count <gpio> <enable>        - Edge counting mode (1=on and reset, 0=off)\n", 
+           prog_name);
+    printf("  %s counters                     - Show edge counts, pulse widths and periods\n", 
+           prog_name);
+    printf("\nEvery bank has its own node, /dev/simple_gpioN; this tool uses %s.\n", 
+           DEVICE_PATH);
+    printf("GPIO numbers count from 0 within the bank, up to its pin count - 1 (at most 31).\n");
 }
 
 int set_gpio_direction(int fd, int gpio_num, int direction)
@@ -178,6 +322,42 @@ int set_gpio_interrupt(int fd, int gpio_num, int enable)
     return 0;
 }
 
+int set_gpio_edge(int fd, int gpio_num, int edge)
+{
+    struct gpio_config config;
+    int ret;
+
+    config.gpio_num = gpio_num;
+    config.value = edge;
+
+    ret = ioctl(fd, GPIO_SET_EDGE, &config);
+    if (ret < 0) {
+        perror("GPIO_SET_EDGE failed");
+        return -1;
+    }
+
+    printf("GPIO %d: Edge mode set to %d\n", gpio_num + 1, edge);
+    return 0;
+}
+
+int set_gpio_debounce(int fd, int gpio_num, int debounce_us)
+{
+    struct gpio_config config;
+    int ret;
+
+    config.gpio_num = gpio_num;
+    config.value = debounce_us;
+
+    ret = ioctl(fd, GPIO_SET_DEBOUNCE, &config);
+    if (ret < 0) {
+        perror("GPIO_SET_DEBOUNCE failed");
+        return -1;
+    }
+
+    printf("GPIO %d: Debounce set to %d us\n", gpio_num + 1, debounce_us);
+    return 0;
+}
+
 int read_gpio_interrupt_status(int fd, int gpio_num)
 {
     struct gpio_config config;
@@ -213,6 +393,577 @@ int clear_gpio_interrupt_status(int fd, int gpio_num)
     return 0;
 }
 
+int run_gpio_batch(int fd, struct gpio_batch_op *ops, unsigned int count)
+{
+    struct gpio_batch batch;
+    unsigned int i;
+    int ret;
+
+    batch.ops = (__u64)(unsigned long)ops;
+    batch.count = count;
+    batch.flags = 0;
+
+    ret = ioctl(fd, GPIO_BATCH, &batch);
+    if (ret < 0) {
+        perror("GPIO_BATCH failed");
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (ops[i].result)
+            printf("  op %u (GPIO %d): error %s\n", 
+                   i, ops[i].gpio_num + 1, strerror(-ops[i].result));
+        else if (ops[i].op == GPIO_OP_READ_PIN || 
+                 ops[i].op == GPIO_OP_READ_INT_STATUS)
+            printf("  op %u (GPIO %d): value = %d\n", 
+                   i, ops[i].gpio_num + 1, ops[i].value);
+    }
+
+    printf("Batch of %u ops executed\n", count);
+    return 0;
+}
+
+int read_gpio_all(int fd)
+{
+    struct gpio_bank_state state;
+    int ret;
+
+    ret = ioctl(fd, GPIO_READ_ALL, &state);
+    if (ret < 0) {
+        perror("GPIO_READ_ALL failed");
+        return -1;
+    }
+
+    printf("Bank: data=0x%02x dir=0x%02x int_en=0x%02x int_status=0x%02x\n", 
+           state.data, state.direction, state.int_enable, state.int_status);
+    return 0;
+}
+
+int write_gpio_mask(int fd, unsigned int mask, unsigned int value)
+{
+    struct gpio_mask m;
+    int ret;
+
+    m.mask = mask;
+    m.value = value;
+
+    ret = ioctl(fd, GPIO_WRITE_MASK, &m);
+    if (ret < 0) {
+        if (errno == EPERM) {
+            printf("Mask 0x%02x: Cannot write - includes an INPUT pin\n", 
+                   mask);
+        } else {
+            perror("GPIO_WRITE_MASK failed");
+        }
+        return -1;
+    }
+
+    printf("Mask 0x%02x: Value set to 0x%02x\n", mask, value & mask);
+    return 0;
+}
+
+int monitor_gpio_events(int fd, int max_events)
+{
+    struct gpio_event events[16];
+    struct gpio_event_stats stats;
+    struct pollfd pfd;
+    int total = 0;
+    ssize_t len;
+    int i, n;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    printf("Waiting for interrupt events (Ctrl-C to stop)...\n");
+
+    while (max_events <= 0 || total < max_events) {
+        if (poll(&pfd, 1, -1) < 0) {
+            perror("poll failed");
+            return -1;
+        }
+
+        len = read(fd, events, sizeof(events));
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            perror("read failed");
+            return -1;
+        }
+
+        n = len / sizeof(events[0]);
+        for (i = 0; i < n; i++) {
+            printf("[%llu.%09llu] #%llu GPIO %u: value = %u\n", 
+                   (unsigned long long)(events[i].timestamp_ns / 1000000000ULL),
+                   (unsigned long long)(events[i].timestamp_ns % 1000000000ULL),
+                   (unsigned long long)events[i].seq, 
+                   events[i].gpio_num + 1, events[i].value);
+        }
+        total += n;
+    }
+
+    if (ioctl(fd, GPIO_GET_EVENT_STATS, &stats) == 0)
+        printf("Events: produced=%llu dropped=%llu queued=%u/%u\n", 
+               (unsigned long long)stats.produced, 
+               (unsigned long long)stats.dropped, 
+               stats.queued, stats.capacity);
+    return 0;
+}
+
+/* Zero-copy consumer, see struct gpio_event_ring for the ordering rules */
+int monitor_gpio_events_mmap(int fd, int max_events)
+{
+    struct gpio_event_ring *ring;
+    struct gpio_event *records, *ev;
+    struct pollfd pfd;
+    size_t map_size;
+    __u32 head, tail;
+    int total = 0;
+
+    /* Map the header first to learn the size of the whole ring */
+    ring = mmap(NULL, sizeof(*ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+    if (ring->magic != GPIO_EVENT_RING_MAGIC || 
+        ring->version != GPIO_EVENT_RING_VERSION) {
+        printf("Unexpected event ring layout\n");
+        munmap(ring, sizeof(*ring));
+        return -1;
+    }
+    map_size = ring->data_offset + (size_t)ring->size * ring->record_size;
+    munmap(ring, sizeof(*ring));
+
+    ring = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+    records = (struct gpio_event *)((char *)ring + ring->data_offset);
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    printf("Waiting for interrupt events via mmap (Ctrl-C to stop)...\n");
+
+    tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    while (max_events <= 0 || total < max_events) {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                perror("poll failed");
+                break;
+            }
+            continue;
+        }
+
+        while (tail != head && (max_events <= 0 || total < max_events)) {
+            ev = &records[tail & (ring->size - 1)];
+            printf("[%llu.%09llu] #%llu GPIO %u: value = %u\n", 
+                   (unsigned long long)(ev->timestamp_ns / 1000000000ULL),
+                   (unsigned long long)(ev->timestamp_ns % 1000000000ULL),
+                   (unsigned long long)ev->seq, ev->gpio_num + 1, ev->value);
+            tail++;
+            total++;
+        }
+
+        /* Give the slots back to the driver */
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+
+    printf("Events: produced=%llu dropped=%llu\n", 
+           (unsigned long long)ring->produced, 
+           (unsigned long long)ring->dropped);
+    munmap(ring, map_size);
+    return 0;
+}
+
+int show_gpio_irq_stats(int fd)
+{
+    struct gpio_irq_stats stats;
+
+    if (ioctl(fd, GPIO_GET_IRQ_STATS, &stats) < 0) {
+        perror("GPIO_GET_IRQ_STATS failed");
+        return -1;
+    }
+
+    printf("IRQs: %llu (%llu with nothing pending)\n", 
+           (unsigned long long)stats.irqs, (unsigned long long)stats.unhandled);
+    printf("Pins scanned: %llu, pending: %llu, hit rate: %.1f%%\n", 
+           (unsigned long long)stats.pins_scanned, 
+           (unsigned long long)stats.pins_pending, 
+           stats.pins_scanned ? 100.0 * stats.pins_pending / stats.pins_scanned : 0.0);
+    printf("Edges filtered by edge mode: %llu, bounces filtered: %llu\n", 
+           (unsigned long long)stats.edges_filtered, 
+           (unsigned long long)stats.bounces_filtered);
+    printf("MMIO per IRQ: %.2f reads, %.2f writes\n", 
+           stats.irqs ? (double)stats.mmio_reads / stats.irqs : 0.0, 
+           stats.irqs ? (double)stats.mmio_writes / stats.irqs : 0.0);
+    return 0;
+}
+
+int show_gpio_stats(int fd)
+{
+    struct gpio_stats stats;
+    int i;
+
+    if (ioctl(fd, GPIO_GET_STATS, &stats) < 0) {
+        perror("GPIO_GET_STATS failed");
+        return -1;
+    }
+
+    printf("%4s %10s %10s %8s %10s %10s %6s %6s\n", "GPIO", "reads", "writes", 
+           "dir_chg", "irqs", "cleared", "eperm", "einval");
+    for (i = 0; i < GPIO_STATS_NR_PINS; i++) {
+        struct gpio_pin_stats *ps = &stats.pins[i];
+
+        /* Banks have up to GPIO_STATS_NR_PINS pins, skip the unused ones */
+        if (!ps->reads && !ps->writes && !ps->direction_changes && !ps->irqs && 
+            !ps->irqs_cleared && !ps->eperm && !ps->einval)
+            continue;
+        printf("%4d %10llu %10llu %8llu %10llu %10llu %6llu %6llu\n", i + 1, 
+               (unsigned long long)ps->reads, (unsigned long long)ps->writes, 
+               (unsigned long long)ps->direction_changes, 
+               (unsigned long long)ps->irqs, (unsigned long long)ps->irqs_cleared, 
+               (unsigned long long)ps->eperm, (unsigned long long)ps->einval);
+    }
+    printf("Device lock: %llu acquisitions, %llu ns held", 
+           (unsigned long long)stats.lock_acquisitions, 
+           (unsigned long long)stats.lock_hold_ns);
+    if (stats.lock_acquisitions)
+        printf(" (%.0f ns avg)", (double)stats.lock_hold_ns / stats.lock_acquisitions);
+    printf("\n");
+    return 0;
+}
+
+int set_gpio_reflex(int fd, struct gpio_reflex *rx)
+{
+    if (ioctl(fd, GPIO_SET_REFLEX, rx) < 0) {
+        perror("GPIO_SET_REFLEX failed");
+        return -1;
+    }
+
+    if (rx->action == GPIO_REFLEX_OFF)
+        printf("Reflex %u: removed\n", rx->index);
+    else
+        printf("Reflex %u: GPIO %u edge %u -> GPIO %u action %u\n", rx->index, 
+               rx->in_gpio + 1, rx->edge, rx->out_gpio + 1, rx->action);
+    return 0;
+}
+
+int show_gpio_reflex_stats(int fd, unsigned int index)
+{
+    struct gpio_reflex_stats stats = { .index = index };
+
+    if (ioctl(fd, GPIO_GET_REFLEX_STATS, &stats) < 0) {
+        perror("GPIO_GET_REFLEX_STATS failed");
+        return -1;
+    }
+
+    printf("Reflex %u: %llu hits, %llu missed\n", index, 
+           (unsigned long long)stats.hits, (unsigned long long)stats.missed);
+    if (stats.hits)
+        printf("Latency: min %llu ns, avg %.0f ns, max %llu ns\n", 
+               (unsigned long long)stats.latency_min_ns, 
+               (double)stats.latency_total_ns / stats.hits, 
+               (unsigned long long)stats.latency_max_ns);
+    return 0;
+}
+
+int set_gpio_pwm(int fd, int gpio_num, unsigned long long period_ns, 
+                 unsigned long long duty_ns)
+{
+    struct gpio_pwm pwm = {
+        .gpio_num = gpio_num,
+        .period_ns = period_ns,
+        .duty_ns = duty_ns,
+    };
+
+    if (ioctl(fd, GPIO_SET_PWM, &pwm) < 0) {
+        perror("GPIO_SET_PWM failed");
+        return -1;
+    }
+
+    if (period_ns)
+        printf("GPIO %d: PWM period %llu ns, duty %llu ns\n", gpio_num + 1, 
+               period_ns, duty_ns);
+    else
+        printf("GPIO %d: PWM stopped\n", gpio_num + 1);
+    return 0;
+}
+
+int show_gpio_pwm_stats(int fd, int gpio_num)
+{
+    struct gpio_pwm_stats stats = { .gpio_num = gpio_num };
+
+    if (ioctl(fd, GPIO_GET_PWM_STATS, &stats) < 0) {
+        perror("GPIO_GET_PWM_STATS failed");
+        return -1;
+    }
+
+    printf("GPIO %d: %llu periods\n", gpio_num + 1, (unsigned long long)stats.periods);
+    printf("Period: requested %llu ns, achieved %llu ns\n", 
+           (unsigned long long)stats.period_ns, 
+           (unsigned long long)stats.achieved_period_ns);
+    printf("Duty:   requested %llu ns, achieved %llu ns\n", 
+           (unsigned long long)stats.duty_ns, 
+           (unsigned long long)stats.achieved_duty_ns);
+    printf("Edge lateness: max %llu ns, avg %.0f ns, %llu periods skipped\n", 
+           (unsigned long long)stats.late_max_ns, 
+           stats.periods ? (double)stats.late_total_ns / (2 * stats.periods) : 0.0, 
+           (unsigned long long)stats.skipped);
+    return 0;
+}
+
+/* count samples toggling the masked pins every delta_ns, through write() */
+int play_gpio_square(int fd, unsigned int mask, unsigned long long delta_ns, int count)
+{
+    struct gpio_out_sample *samples;
+    ssize_t ret;
+    int i;
+
+    if (count <= 0)
+        return -1;
+
+    samples = calloc(count, sizeof(*samples));
+    if (!samples)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        samples[i].mask = mask;
+        samples[i].value = (i & 1) ? 0 : mask;
+        samples[i].delta_ns = delta_ns;
+    }
+
+    /* Blocks while the queue is full, so this follows the playback */
+    ret = write(fd, samples, count * sizeof(*samples));
+    free(samples);
+    if (ret < 0) {
+        perror("write failed");
+        return -1;
+    }
+
+    printf("Queued %zd samples\n", ret / (ssize_t)sizeof(struct gpio_out_sample));
+    return 0;
+}
+
+int set_gpio_out_mode(int fd, unsigned int mode)
+{
+    if (ioctl(fd, GPIO_SET_OUT_MODE, &mode) < 0) {
+        perror("GPIO_SET_OUT_MODE failed");
+        return -1;
+    }
+
+    printf("Paced output mode set to 0x%x\n", mode);
+    return 0;
+}
+
+int show_gpio_out_stats(int fd)
+{
+    struct gpio_out_stats stats;
+
+    if (ioctl(fd, GPIO_GET_OUT_STATS, &stats) < 0) {
+        perror("GPIO_GET_OUT_STATS failed");
+        return -1;
+    }
+
+    printf("Played: %llu, rejected: %llu, underruns: %llu\n", 
+           (unsigned long long)stats.played, (unsigned long long)stats.rejected, 
+           (unsigned long long)stats.underruns);
+    printf("Queued: %u/%u, %s%s, worst lateness %llu ns\n", stats.queued, 
+           stats.capacity, stats.running ? "running" : "idle", 
+           (stats.flags & GPIO_OUT_LOOP) ? ", looping" : "", 
+           (unsigned long long)stats.late_max_ns);
+    return 0;
+}
+
+int run_gpio_capture(int fd, struct gpio_capture_config *cfg)
+{
+    struct gpio_capture_status status;
+    struct gpio_capture_run *runs;
+    size_t map_size = GPIO_CAPTURE_RUNS * sizeof(struct gpio_capture_run);
+    unsigned long long t;
+    unsigned int i;
+
+    if (ioctl(fd, GPIO_CAPTURE_START, cfg) < 0) {
+        perror("GPIO_CAPTURE_START failed");
+        return -1;
+    }
+
+    printf("Capture armed, waiting for the trigger...\n");
+    do {
+        usleep(10000);
+        if (ioctl(fd, GPIO_CAPTURE_STATUS, &status) < 0) {
+            perror("GPIO_CAPTURE_STATUS failed");
+            return -1;
+        }
+    } while (status.state != GPIO_CAPTURE_DONE);
+
+    runs = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, GPIO_CAPTURE_MMAP_OFFSET);
+    if (runs == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+
+    printf("%llu samples in %u runs, trigger at sample %llu%s, %llu late ticks\n", 
+           (unsigned long long)status.samples, status.nr_runs, 
+           (unsigned long long)status.trigger_sample, 
+           status.truncated ? " (buffer full)" : "", 
+           (unsigned long long)status.late_ticks);
+
+    t = 0;
+    for (i = 0; i < status.nr_runs; i++) {
+        struct gpio_capture_run *run = &runs[(status.first_run + i) % status.capacity];
+
+        printf("%12llu ns  0x%08x  x%u\n", 
+               (unsigned long long)(t * cfg->period_ns), run->value, run->count);
+        t += run->count;
+    }
+
+    munmap(runs, map_size);
+    return 0;
+}
+
+int run_gpio_spi(int fd, struct gpio_xfer *xfer, int nbytes, char **bytes)
+{
+    unsigned char tx[64], rx[64];
+    int i;
+
+    for (i = 0; i < nbytes; i++)
+        tx[i] = strtoul(bytes[i], NULL, 0);
+    xfer->tx_len = nbytes;
+    xfer->tx_buf = (unsigned long)tx;
+    xfer->rx_buf = (unsigned long)rx;
+
+    if (ioctl(fd, GPIO_XFER, xfer) < 0) {
+        perror("GPIO_XFER failed");
+        printf("%u of %d bytes transferred\n", xfer->tx_done, nbytes);
+        return -1;
+    }
+
+    printf("rx:");
+    for (i = 0; i < (int)xfer->rx_done; i++)
+        printf(" %02x", rx[i]);
+    printf("\n%u bytes in %llu ns, %llu bit/s\n", xfer->tx_done, 
+           (unsigned long long)xfer->duration_ns, 
+           (unsigned long long)xfer->bit_rate);
+    return 0;
+}
+
+int run_gpio_seq_sample(int fd, int gpio_num, unsigned long long period_ns, int words)
+{
+    /* One sample per tick, a word to the FIFO every 8, blocking when it is full */
+    struct gpio_seq_insn prog[] = {
+        { .op = GPIO_SEQ_LOAD, .arg = 7 },
+        { .op = GPIO_SEQ_IN, .pin = gpio_num },
+        { .op = GPIO_SEQ_DELAY, .arg = 1 },
+        { .op = GPIO_SEQ_JMP, .cond = GPIO_SEQ_X_DEC, .arg = 1 },
+        { .op = GPIO_SEQ_PUSH },
+        { .op = GPIO_SEQ_JMP, .cond = GPIO_SEQ_ALWAYS, .arg = 0 },
+    };
+    struct gpio_seq_program load = {
+        .index = 0,
+        .ninsns = sizeof(prog) / sizeof(prog[0]),
+        .steps_per_tick = 8,
+        .period_ns = period_ns,
+        .insns = (unsigned long)prog,
+    };
+    struct gpio_seq_fifo fifo;
+    int got = 0;
+    unsigned int i;
+
+    if (ioctl(fd, GPIO_SEQ_LOAD_PROG, &load) < 0) {
+        perror("GPIO_SEQ_LOAD_PROG failed");
+        return -1;
+    }
+
+    while (got < words) {
+        usleep(10000);
+        fifo.index = 0;
+        if (ioctl(fd, GPIO_SEQ_POP, &fifo) < 0) {
+            perror("GPIO_SEQ_POP failed");
+            break;
+        }
+        for (i = 0; i < fifo.count && got < words; i++, got++)
+            printf("%02x%s", fifo.values[i] & 0xff, (got % 16 == 15) ? "\n" : " ");
+    }
+    printf("\n");
+
+    load.ninsns = 0;
+    ioctl(fd, GPIO_SEQ_LOAD_PROG, &load);
+    return show_gpio_seq_status(fd, 0);
+}
+
+int show_gpio_seq_status(int fd, unsigned int index)
+{
+    static const char * const states[] = { "idle", "running", "done", "fault" };
+    struct gpio_seq_status status = { .index = index };
+
+    if (ioctl(fd, GPIO_SEQ_GET_STATUS, &status) < 0) {
+        perror("GPIO_SEQ_GET_STATUS failed");
+        return -1;
+    }
+
+    printf("Sequencer %u: %s at pc %u, x=%u isr=0x%x, %u words queued\n", index, 
+           status.state < 4 ? states[status.state] : "?", status.pc, status.x, 
+           status.isr, status.fifo_level);
+    printf("  %llu ticks, %llu steps, %llu stalled, %llu out of budget, "
+           "%llu late, %llu overflows\n", 
+           (unsigned long long)status.ticks, (unsigned long long)status.steps, 
+           (unsigned long long)status.stall_ticks, 
+           (unsigned long long)status.budget_ticks, 
+           (unsigned long long)status.late_ticks, 
+           (unsigned long long)status.fifo_overflows);
+    return 0;
+}
+
+int set_gpio_counter(int fd, int gpio_num, int enable)
+{
+    struct gpio_config config = { .gpio_num = gpio_num, .value = enable };
+
+    if (ioctl(fd, GPIO_SET_COUNTER, &config) < 0) {
+        perror("GPIO_SET_COUNTER failed");
+        return -1;
+    }
+
+    printf("GPIO%d: Edge counting %s\n", gpio_num + 1, enable ? "on" : "off");
+    return 0;
+}
+
+int show_gpio_counters(int fd)
+{
+    struct gpio_counters *cnt;
+    int i;
+
+    cnt = malloc(sizeof(*cnt));
+    if (!cnt)
+        return -1;
+
+    if (ioctl(fd, GPIO_GET_COUNTERS, cnt) < 0) {
+        perror("GPIO_GET_COUNTERS failed");
+        free(cnt);
+        return -1;
+    }
+
+    printf("%4s %10s %10s %6s %30s %30s\n", "gpio", "rising", "falling", "missed", 
+           "width min/avg/max (us)", "period min/avg/max (us)");
+    for (i = 0; i < GPIO_COUNTER_NR_PINS; i++) {
+        struct gpio_counter *c = &cnt->pins[i];
+
+        if (!(cnt->mask & (1u << i)) && !c->rising && !c->falling)
+            continue;
+        printf("%4d %10llu %10llu %6llu %10.1f %9.1f %9.1f %10.1f %9.1f %9.1f%s\n", i, 
+               (unsigned long long)c->rising, (unsigned long long)c->falling, 
+               (unsigned long long)c->missed, 
+               c->width_min_ns / 1e3, c->width_avg_ns / 1e3, c->width_max_ns / 1e3, 
+               c->period_min_ns / 1e3, c->period_avg_ns / 1e3, c->period_max_ns / 1e3, 
+               (cnt->mask & (1u << i)) ? "" : " (off)");
+    }
+
+    free(cnt);
+    return 0;
+}
+
 void demo_all_functions(int fd)
 {
     printf("=== Running GPIO Driver Demo ===\n\n");
@@ -235,6 +986,7 @@ void demo_all_functions(int fd)
     printf("--- Testing Interrupt on GPIO 3 ---\n");
     set_gpio_direction(fd, 2, GPIO_DIR_INPUT);
     set_gpio_interrupt(fd, 2, GPIO_INT_ENABLE);
+    set_gpio_edge(fd, 2, GPIO_EDGE_FALLING);
     read_gpio_interrupt_status(fd, 2);
     printf("Note: To test actual interrupts, external hardware signal changes are needed\n");
     printf("\n");
@@ -262,6 +1014,28 @@ void demo_all_functions(int fd)
     }
     printf("\n");
 
+    /* Same pattern as one GPIO_BATCH syscall */
+    printf("--- Testing Batched Operations ---\n");
+    {
+        struct gpio_batch_op ops[] = {
+            { GPIO_OP_SET_DIRECTION, 0, GPIO_DIR_OUTPUT, 0 },
+            { GPIO_OP_WRITE_PIN,     0, 1,               0 },
+            { GPIO_OP_SET_DIRECTION, 1, GPIO_DIR_INPUT,  0 },
+            { GPIO_OP_READ_PIN,      1, 0,               0 },
+            { GPIO_OP_WRITE_PIN,     1, 1,               0 }, /* input, fails */
+            { GPIO_OP_READ_INT_STATUS, 2, 0,             0 },
+        };
+
+        run_gpio_batch(fd, ops, sizeof(ops) / sizeof(ops[0]));
+    }
+    printf("\n");
+
+    /* Whole-bank access */
+    printf("--- Testing Whole-Bank Access ---\n");
+    write_gpio_mask(fd, 0x0f, 0x05);
+    read_gpio_all(fd);
+    printf("\n");
+
     /* Read all input pins */
     printf("--- Reading All Input Pins ---\n");
     for (int i = 0; i < 8; i++) {
@@ -0,0 +1,94 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM simple_gpio
+
+#if !defined(_GPIO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _GPIO_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(gpio_ioctl_enter,
+    TP_PROTO(unsigned int cmd, unsigned long arg),
+    TP_ARGS(cmd, arg),
+    TP_STRUCT__entry(
+        __field(unsigned int, cmd)
+        __field(unsigned long, arg)
+    ),
+    TP_fast_assign(
+        __entry->cmd = cmd;
+        __entry->arg = arg;
+    ),
+    TP_printk("nr=%u cmd=0x%08x arg=0x%lx", 
+              _IOC_NR(__entry->cmd), __entry->cmd, __entry->arg)
+);
+
+TRACE_EVENT(gpio_ioctl_exit,
+    TP_PROTO(unsigned int cmd, long ret, u64 duration_ns),
+    TP_ARGS(cmd, ret, duration_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, cmd)
+        __field(long, ret)
+        __field(u64, duration_ns)
+    ),
+    TP_fast_assign(
+        __entry->cmd = cmd;
+        __entry->ret = ret;
+        __entry->duration_ns = duration_ns;
+    ),
+    TP_printk("nr=%u ret=%ld duration_ns=%llu", 
+              _IOC_NR(__entry->cmd), __entry->ret, __entry->duration_ns)
+);
+
+/* gpio_dev->lock taken for a multi-pin operation */
+TRACE_EVENT(gpio_lock_acquire,
+    TP_PROTO(u32 mask, u64 wait_ns),
+    TP_ARGS(mask, wait_ns),
+    TP_STRUCT__entry(
+        __field(u32, mask)
+        __field(u64, wait_ns)
+    ),
+    TP_fast_assign(
+        __entry->mask = mask;
+        __entry->wait_ns = wait_ns;
+    ),
+    TP_printk("pins=0x%02x wait_ns=%llu", __entry->mask, __entry->wait_ns)
+);
+
+TRACE_EVENT(gpio_irq_entry,
+    TP_PROTO(int irq, unsigned long enabled),
+    TP_ARGS(irq, enabled),
+    TP_STRUCT__entry(
+        __field(int, irq)
+        __field(unsigned long, enabled)
+    ),
+    TP_fast_assign(
+        __entry->irq = irq;
+        __entry->enabled = enabled;
+    ),
+    TP_printk("irq=%d enabled=0x%02lx", __entry->irq, __entry->enabled)
+);
+
+/* A W1TC acknowledge, from the IRQ handler or GPIO_CLEAR_INT_STATUS */
+TRACE_EVENT(gpio_int_clear,
+    TP_PROTO(int gpio_num, u32 reg_val, bool in_irq),
+    TP_ARGS(gpio_num, reg_val, in_irq),
+    TP_STRUCT__entry(
+        __field(int, gpio_num)
+        __field(u32, reg_val)
+        __field(bool, in_irq)
+    ),
+    TP_fast_assign(
+        __entry->gpio_num = gpio_num;
+        __entry->reg_val = reg_val;
+        __entry->in_irq = in_irq;
+    ),
+    TP_printk("gpio=%d reg=0x%08x %s", __entry->gpio_num, __entry->reg_val, 
+              __entry->in_irq ? "irq" : "ioctl")
+);
+
+#endif /* _GPIO_TRACE_H */
+
+/* Out-of-tree module: the header sits next to the source, see Makefile */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE gpio_trace
+#include <trace/define_trace.h>